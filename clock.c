@@ -1,6 +1,6 @@
 /* 
- * clock.c - Routines for using the cycle counters on x86, 
- *           Alpha, and Sparc boxes.
+ * clock.c - Routines for using the cycle counters on x86, x86-64,
+ *           Arm64, Alpha, and Sparc boxes.
  * 
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
 #include <sys/times.h>
 #include "clock.h"
 
@@ -16,7 +17,7 @@
 /******************************************************* 
  * Machine dependent functions 
  *
- * Note: the constants __i386__ and  __alpha
+ * Note: the constants __i386__, __x86_64__, __aarch64__ and __alpha
  * are set by GCC when it calls the C preprocessor
  * You can verify this for yourself using gcc -v.
  *******************************************************/
@@ -71,6 +72,45 @@ double get_counter()
 }
 /* $end x86cyclecounter */
 
+#elif defined(__x86_64__) || defined(__aarch64__)
+/*************************************************************
+ * x86-64 and Arm64 versions of start_counter() and get_counter()
+ *************************************************************/
+
+/* Initialize the cycle counter */
+static unsigned long long cyc_start = 0;
+
+/* Return the 64-bit counter. On x86-64 this is the time stamp counter,
+   read with rdtscp so that earlier instructions finish first; on Arm64
+   it is the virtual counter, read after an isb for the same reason.
+   Neither counts core cycles exactly, so mhz() measures the rate. */
+static unsigned long long access_counter(void)
+{
+#if defined(__x86_64__)
+    unsigned hi, lo, aux;
+
+    asm volatile("rdtscp" : "=a" (lo), "=d" (hi), "=c" (aux));
+    return ((unsigned long long)hi << 32) | lo;
+#else
+    unsigned long long t;
+
+    asm volatile("isb; mrs %0, cntvct_el0" : "=r" (t) : : "memory");
+    return t;
+#endif
+}
+
+/* Record the current value of the cycle counter. */
+void start_counter()
+{
+    cyc_start = access_counter();
+}
+
+/* Return the number of cycles since the last call to start_counter. */
+double get_counter()
+{
+    return (double)(access_counter() - cyc_start);
+}
+
 #elif defined(__alpha)
 
 /****************************************************
@@ -140,23 +180,26 @@ double get_counter()
  * counter routines. Newer models of sparcs (v8plus) have cycle
  * counters that can be accessed from user programs, but since there
  * are still many sparc boxes out there that don't support this, we
- * haven't provided a Sparc version here.
+ * haven't provided a Sparc version here. These versions count the
+ * nanoseconds of CLOCK_MONOTONIC_RAW instead, which mhz() then
+ * reports as a 1000 MHz clock.
  ***************************************************************/
 
+/* Initialize the counter */
+static struct timespec cyc_start;
+
 void start_counter()
 {
-    printf("ERROR: You are trying to use a start_counter routine in clock.c\n");
-    printf("that has not been implemented yet on this platform.\n");
-    printf("Please choose another timing package in config.h.\n");
-    exit(1);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &cyc_start);
 }
 
 double get_counter() 
 {
-    printf("ERROR: You are trying to use a get_counter routine in clock.c\n");
-    printf("that has not been implemented yet on this platform.\n");
-    printf("Please choose another timing package in config.h.\n");
-    exit(1);
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+    return (now.tv_sec - cyc_start.tv_sec) * 1e9 + 
+	(now.tv_nsec - cyc_start.tv_nsec);
 }
 #endif
 
@@ -195,10 +238,38 @@ double mhz_full(int verbose, int sleeptime)
 }
 /* $end mhz */
 
-/* Version using a default sleeptime */
+/* Number and length of the intervals mhz() times */
+#define MHZ_RUNS 5
+#define MHZ_NSECS 20000000
+
+/* Estimate the clock rate by timing a few short intervals of
+   CLOCK_MONOTONIC_RAW with the counter, keeping the median rate.
+   This takes a tenth of a second rather than mhz_full's sleep. */
 double mhz(int verbose)
 {
-    return mhz_full(verbose, 2);
+    double rates[MHZ_RUNS], rate, ns;
+    struct timespec start, now;
+    int i, j;
+
+    for (i = 0; i < MHZ_RUNS; i++) {
+	clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+	start_counter();
+	do {
+	    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+	    ns = (now.tv_sec - start.tv_sec) * 1e9 + 
+		(now.tv_nsec - start.tv_nsec);
+	} while (ns < MHZ_NSECS);
+	rate = get_counter() / (ns * 1e-3);
+
+	/* insertion sort, so that the median ends up in the middle */
+	for (j = i; j > 0 && rates[j-1] > rate; j--)
+	    rates[j] = rates[j-1];
+	rates[j] = rate;
+    }
+    rate = rates[MHZ_RUNS / 2];
+    if (verbose) 
+	printf("Processor clock rate ~= %.1f MHz\n", rate);
+    return rate;
 }
 
 /** Special counters that compensate for timer interrupt overhead */
@@ -270,6 +341,11 @@ double get_comp_counter()
     times(&t);
     ticks = t.tms_utime - start_tick;
     ctime = time - ticks*cyc_per_tick;
+
+    /* A calibration that found no tick, or a bogus one, must not cancel
+       the measurement out */
+    if (!(cyc_per_tick > 0.0) || ctime <= 0.0)
+	ctime = time;
     /*
       printf("Measured %.0f cycles.  Ticks = %d.  Corrected %.0f cycles\n",
       time, (int) ticks, ctime);
@@ -7,6 +7,7 @@
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
  */
+#define _GNU_SOURCE  /* sched_setaffinity */
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -15,10 +16,17 @@
 #include <assert.h>
 #include <float.h>
 #include <time.h>
-
-#include "mm.h"
+#include <pthread.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "mm_variants.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "clock.h"
 #include "config.h"
 
 /**********************
@@ -27,9 +35,30 @@
 
 /* Misc */
 #define MAXLINE     1024 /* max string size */
+#define MAXVARIANTS   16 /* most mm packages -s can select */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
 
+/* Multi-threaded replay (-T) */
+#define MT_MAXTHREADS 64 /* most threads -T will start */
+#define MT_REPS        3 /* keep the fastest of this many runs per point */
+
+/* Parallel evaluation (-j) */
+#define MAXJOBS       64 /* most worker processes -j will run at once */
+
+/* Per-op latency histograms (-L) */
+#define LAT_SUB_BITS   2 /* each power of two is split into 4 buckets */
+#define LAT_BUCKETS (64 << LAT_SUB_BITS)
+#define LAT_CALIBRATE 10000 /* counter reads used to find its overhead */
+
+/* Binary trace files start with this magic string */
+#define BIN_MAGIC   "MMTRACE"
+#define BIN_VERSION    2
+
+/* Streamed traces (-R) */
+#define STREAM_IDS  1024 /* initial size of the live id table and blocks */
+#define ID_HASH(id, mask) (((unsigned)(id) * 2654435761u) & (mask))
+
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((unsigned int)(p)) % ALIGNMENT) == 0)
 
@@ -37,31 +66,85 @@
  * The key compound data types 
  *****************************/
 
-/* Records the extent of each block's payload */
+/* Records the extent of each block's payload in an AVL tree by address */
 typedef struct range_t {
     char *lo;              /* low payload address */
     char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
+    struct range_t *left;  /* payloads at lower addresses */
+    struct range_t *right; /* payloads at higher addresses */
+    int height;            /* height of the subtree rooted here */
 } range_t;
 
 /* Characterizes a single trace operation (allocator request) */
 typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
+    enum {ALLOC, FREE, REALLOC, CALLOC, MEMALIGN,
+	  ALLOC_BATCH, FREE_BATCH} type; /* type of request */
     int index;                        /* index for free() to use later */
     int size;                         /* byte size of alloc/realloc request */
+    int arg;                          /* alignment of a memalign request,
+					 or the number of blocks (with ids
+					 index, index+1, ...) of a batch */
 } traceop_t;
 
+/*
+ * Header of a binary trace file. It is followed directly by num_ops
+ * records laid out exactly like traceop_t (four ints in host byte
+ * order), so the records can be replayed in place from a mapping.
+ */
+typedef struct {
+    char magic[8];       /* BIN_MAGIC, NUL terminated */
+    int version;         /* BIN_VERSION */
+    int sugg_heapsize;   /* suggested heap size (unused) */
+    int num_ids;         /* number of alloc/realloc ids */
+    int num_ops;         /* number of distinct requests */
+    int weight;          /* weight for this trace (unused) */
+    int reserved;        /* pads the header to 32 bytes */
+} binhdr_t;
+
+/* Maps a live id of a streamed trace to its slot in trace->blocks */
+typedef struct {
+    int id;              /* id from the trace, or -1 for an empty entry */
+    int slot;            /* entry in trace->blocks it was given */
+} idslot_t;
+
+/* Decodes a streamed trace (-R) a chunk of requests at a time */
+typedef struct {
+    FILE *file;          /* the trace file... */
+    char *path;          /* ... and its name */
+    int binary;          /* holds binary records rather than text lines */
+    long start;          /* file offset of the first request */
+    int decoded;         /* requests decoded since the last rewind */
+    idslot_t *ids;       /* open-addressed hash table of the live ids */
+    int ids_len;         /* entries in ids, a power of two */
+    int live;            /* live ids in the table */
+    int *free_slots;     /* stack of slots no live id is using... */
+    int nfree;           /* ... and its depth */
+    int nslots;          /* slots handed out since the last rewind */
+    int max_slots;       /* room in blocks, block_sizes and free_slots */
+    double decode_secs;  /* time spent decoding since the last rewind */
+} stream_t;
+
 /* Holds the information for one trace file*/
 typedef struct {
     int sugg_heapsize;   /* suggested heap size (unused) */
     int num_ids;         /* number of alloc/realloc ids */
     int num_ops;         /* number of distinct requests */
     int weight;          /* weight for this trace (unused) */
+    long num_reqs;       /* blocks allocated or freed, for throughput */
     traceop_t *ops;      /* array of requests */
     char **blocks;       /* array of ptrs returned by malloc/realloc... */
     size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+    void *map;           /* mapping of a binary trace file, or NULL */
+    size_t map_len;      /* length of that mapping */
+    int pos;             /* next request in ops to replay... */
+    int count;           /* ... and the number of requests in ops */
+    stream_t *stream;    /* decoder of a streamed trace, or NULL */
 } trace_t;
 
+/* The next request of a trace, decoding another chunk if it's streamed */
+#define NEXT_OP(trace) ((trace)->pos < (trace)->count ? \
+			&(trace)->ops[(trace)->pos++] : next_chunk(trace))
+
 /* 
  * Holds the params to the xxx_speed functions, which are timed by fcyc. 
  * This struct is necessary because fcyc accepts only a pointer array
@@ -72,6 +155,21 @@ typedef struct {
     range_t *ranges;
 } speed_t;
 
+/* Log-bucketed histogram of the latencies of one type of request */
+typedef struct {
+    unsigned long count[LAT_BUCKETS]; /* requests per bucket */
+    unsigned long n;                  /* requests in all buckets */
+    unsigned long long max;           /* slowest request */
+} lathist_t;
+
+/* Holds the params and results of one replay thread in -T mode */
+typedef struct {
+    trace_t trace;        /* private copy with its own blocks array */
+    int libc;             /* replay with libc malloc instead of mm */
+    pthread_barrier_t *start; /* released once every thread is ready */
+    double begin, end;    /* when this thread started and finished */
+} mtarg_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* defined for both libc malloc and student malloc package (mm.c) */
@@ -81,16 +179,34 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    double reclaimed; /* bytes the package gave back by shrinking the heap */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
 
+/* Evaluates one trace, filling in its stats and adding to the latencies */
+typedef void (*evaltrace_t)(char *tracefile, int tracenum, stats_t *stats,
+			    lathist_t *lat);
+
+/* What a -j worker sends back after evaluating its trace */
+typedef struct {
+    stats_t stats;        /* the trace's stats */
+    int errors;           /* errors found while evaluating it */
+    lathist_t lat[3];     /* latencies of each type of mm request */
+} jobresult_t;
+
 /********************
  * Global variables
  *******************/
 int verbose = 0;        /* global flag for verbose output */
 static int errors = 0;  /* number of errs found when running student malloc */
 char msg[MAXLINE];      /* for whenever we need to compose an error message */
+static unsigned long long lat_overhead = 0; /* cost of reading the counter */
+static mm_variant_t *mm;  /* the mm package being evaluated */
+static int telemetry_ops = 0; /* ops between telemetry samples (-S) */
+static int stream_ops = 0; /* requests decoded at a time when streaming (-R) */
+static int jobs = 1;       /* traces evaluated at once by workers (-j) */
+static size_t heap_limit = MAX_HEAP; /* bytes reserved for the heap (-m) */
 
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
@@ -105,28 +221,91 @@ static char *default_tracefiles[] = {
  * Function prototypes 
  *********************/
 
-/* these functions manipulate range lists */
+/* these functions manipulate range trees */
 static int add_range(range_t **ranges, char *lo, int size, 
 		     int tracenum, int opnum);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
+static range_t *find_overlap(range_t *t, char *lo, char *hi);
+static range_t *insert_range(range_t *t, range_t *p);
+static range_t *delete_range(range_t *t, char *lo);
+static range_t *delete_min_range(range_t *t, range_t **min);
+static range_t *balance_range(range_t *t);
+static range_t *rotate_range(range_t *t, int left);
+static int range_height(range_t *t);
 
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(char *tracedir, char *filename);
+static int map_trace(trace_t *trace, int fd, char *path);
+static int read_op(FILE *tracefile, traceop_t *op, char *path);
+static long count_reqs(traceop_t *ops, int num_ops);
 static void free_trace(trace_t *trace);
 
+/* Streaming traces that are too large to load */
+static trace_t *open_stream(trace_t *trace, char *path);
+static void rewind_trace(trace_t *trace);
+static traceop_t *next_chunk(trace_t *trace);
+static int stream_slot(trace_t *trace, traceop_t *op);
+static void grow_slots(trace_t *trace);
+static void grow_ids(stream_t *stream);
+static double stream_secs(void (*f)(void *), void *argp);
+
+/* Evaluate a whole trace, one after another or in parallel (-j) */
+static void eval_libc_trace(char *tracefile, int tracenum, stats_t *stats,
+			    lathist_t *lat);
+static void eval_mm_trace(char *tracefile, int tracenum, stats_t *stats,
+			  lathist_t *lat);
+static void eval_suite(evaltrace_t eval, char **tracefiles, 
+		       int num_tracefiles, stats_t *stats, lathist_t *lat);
+static pid_t start_worker(evaltrace_t eval, char *tracefile, int tracenum,
+			  int cpu, lathist_t *lat, int *fd);
+static void finish_worker(pid_t pid, int status, int fd, char *tracefile,
+			  int tracenum, stats_t *stats, lathist_t *lat);
+
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace, int tracenum);
 static void eval_libc_speed(void *ptr);
+static inline char *libc_alloc_op(traceop_t *op);
+static inline void libc_batch_op(traceop_t *op, char **blocks);
 
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   double *reclaimed, FILE *telemetry);
 static void eval_mm_speed(void *ptr);
+static void replay_mm(trace_t *trace);
+static inline char *mm_alloc_op(traceop_t *op);
+static inline int mm_batch_op(traceop_t *op, char **blocks);
+
+/* Routines for recording how the heap changes during a trace (-S) */
+static FILE *open_telemetry(char *tracedir, char *filename);
+static void write_telemetry_header(FILE *telemetry);
+static void write_telemetry(FILE *telemetry, int opnum, int payload);
+
+/* Routines for timing each request of the mm malloc package (-L) */
+static void eval_mm_latency(trace_t *trace, lathist_t *hist);
+static void lat_calibrate(void);
+static void lat_record(lathist_t *hist, unsigned long long t);
+static int lat_bucket(unsigned long long t);
+static unsigned long long lat_bucket_top(int i);
+static unsigned long long lat_percentile(lathist_t *hist, double p);
+static void printlatency(lathist_t *hist);
+
+/* Routines for replaying traces on several threads at once (-T) */
+static void eval_mt(char **tracefiles, int num_tracefiles, int nthreads,
+		    int run_libc);
+static double eval_mt_speed(trace_t **traces, int ntraces, int nthreads,
+			    int libc, double *thread_kops);
+static void *mt_thread(void *ptr);
+static double mt_now(void);
 
 /* Various helper routines */
+static int select_variants(char *names, mm_variant_t **variants);
+static double perf_index(int n, stats_t *stats, double *p1, double *p2);
 static void printresults(int n, stats_t *stats);
+static void printcompare(int n, int num_variants, mm_variant_t **variants,
+			 stats_t **stats);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -141,24 +320,28 @@ int main(int argc, char **argv)
     char c;
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
-    trace_t *trace = NULL;     /* stores a single trace file in memory */
-    range_t *ranges = NULL;    /* keeps track of block extents for one trace */
     stats_t *libc_stats = NULL;/* libc stats for each trace */
-    stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
-    speed_t speed_params;      /* input parameters to the xx_speed routines */ 
+    stats_t **mm_stats = NULL; /* mm stats for each variant and trace */
 
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    int mt_threads = 0;  /* If set, replay on 1..mt_threads threads (-T) */
+    int latency = 0;     /* If set, time each mm request (set by -L) */
+    lathist_t *lat = NULL; /* latencies of each type of mm request */
+    char *variant_names = NULL; /* mm packages to evaluate (set by -s) */
+    mm_variant_t *variants[MAXVARIANTS]; /* ... and the packages themselves */
+    int num_variants, v;
+    int total_errors = 0; /* errors summed over the variants */
 
     /* temporaries used to compute the performance index */
-    double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
+    double p1, p2, perfindex;
     int numcorrect;
     
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:j:m:s:R:S:T:hvVgalL")) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -178,12 +361,50 @@ int main(int argc, char **argv)
 	    if (tracedir[strlen(tracedir)-1] != '/') 
 		strcat(tracedir, "/"); /* path always ends with "/" */
 	    break;
+	case 'j': /* Evaluate this many traces at once, each on its own core */
+	    jobs = atoi(optarg);
+	    if (jobs < 1 || jobs > MAXJOBS) {
+		fprintf(stderr, "-j takes 1 to %d jobs\n", MAXJOBS);
+		exit(1);
+	    }
+	    break;
+	case 'm': /* Megabytes of address space to reserve for the heap */
+	    heap_limit = (size_t)atol(optarg) << 20;
+	    mem_set_max_heap(heap_limit);
+	    break;
+	case 's': /* Comma-separated names of the mm packages to evaluate */
+	    variant_names = optarg;
+	    break;
+	case 'R': /* Stream the traces, decoding this many requests at a time */
+	    stream_ops = atoi(optarg);
+	    if (stream_ops < 1) {
+		fprintf(stderr, "-R takes a positive number of ops\n");
+		exit(1);
+	    }
+	    break;
+	case 'S': /* Record heap telemetry every this many ops */
+	    telemetry_ops = atoi(optarg);
+	    if (telemetry_ops < 1) {
+		fprintf(stderr, "-S takes a positive number of ops\n");
+		exit(1);
+	    }
+	    break;
+	case 'T': /* Replay the traces on up to this many threads */
+	    mt_threads = atoi(optarg);
+	    if (mt_threads < 1 || mt_threads > MT_MAXTHREADS) {
+		fprintf(stderr, "-T takes 1 to %d threads\n", MT_MAXTHREADS);
+		exit(1);
+	    }
+	    break;
         case 'a': /* Don't check team structure */
             team_check = 0;
             break;
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+	case 'L': /* Time each mm request and report latency percentiles */
+	    latency = 1;
+	    break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -198,31 +419,45 @@ int main(int argc, char **argv)
             exit(1);
         }
     }
+
+    /* Each -T thread needs the whole trace, and the whole machine */
+    if (mt_threads && stream_ops) {
+	fprintf(stderr, "-R can't be combined with -T\n");
+	exit(1);
+    }
+    if (mt_threads && jobs > 1) {
+	fprintf(stderr, "-j can't be combined with -T\n");
+	exit(1);
+    }
+
+    /* Look up the mm packages, the default one if there was no -s */
+    num_variants = select_variants(variant_names, variants);
+    mm = variants[0];
 	
     /* 
      * Check and print team info 
      */
     if (team_check) {
 	/* Students must fill in their team information */
-	if (!strcmp(team.teamname, "")) {
+	if (!strcmp(mm->team->teamname, "")) {
 	    printf("ERROR: Please provide the information about your team in mm.c.\n");
 	    exit(1);
 	} else
-	    printf("Team Name:%s\n", team.teamname);
-	if ((*team.name1 == '\0') || (*team.id1 == '\0')) {
+	    printf("Team Name:%s\n", mm->team->teamname);
+	if ((*mm->team->name1 == '\0') || (*mm->team->id1 == '\0')) {
 	    printf("ERROR.  You must fill in all team member 1 fields!\n");
 	    exit(1);
 	} 
 	else
-	    printf("Member 1 :%s:%s\n", team.name1, team.id1);
+	    printf("Member 1 :%s:%s\n", mm->team->name1, mm->team->id1);
 
-	if (((*team.name2 != '\0') && (*team.id2 == '\0')) ||
-	    ((*team.name2 == '\0') && (*team.id2 != '\0'))) { 
+	if (((*mm->team->name2 != '\0') && (*mm->team->id2 == '\0')) ||
+	    ((*mm->team->name2 == '\0') && (*mm->team->id2 != '\0'))) { 
 	    printf("ERROR.  You must fill in all or none of the team member 2 ID fields!\n");
 	    exit(1);
 	}
-	else if (*team.name2 != '\0')
-	    printf("Member 2 :%s:%s\n", team.name2, team.id2);
+	else if (*mm->team->name2 != '\0')
+	    printf("Member 2 :%s:%s\n", mm->team->name2, mm->team->id2);
     }
 
     /* 
@@ -235,6 +470,19 @@ int main(int argc, char **argv)
 	printf("Using default tracefiles in %s\n", tracedir);
     }
 
+    /* The multi-threaded mode replaces the usual evaluation */
+    if (mt_threads) {
+	for (v = 0; v < num_variants; v++) {
+	    mm = variants[v];
+	    if (!mm->thread_safe) {
+		printf("\nSkipping %s, which is not thread-safe\n", mm->name);
+		continue;
+	    }
+	    eval_mt(tracefiles, num_tracefiles, mt_threads, run_libc);
+	}
+	exit(errors != 0);
+    }
+
     /* Initialize the timing package */
     init_fsecs();
 
@@ -251,20 +499,8 @@ int main(int argc, char **argv)
 	    unix_error("libc_stats calloc in main failed");
 	
 	/* Evaluate the libc malloc package using the K-best scheme */
-	for (i=0; i < num_tracefiles; i++) {
-	    trace = read_trace(tracedir, tracefiles[i]);
-	    libc_stats[i].ops = trace->num_ops;
-	    if (verbose > 1)
-		printf("Checking libc malloc for correctness, ");
-	    libc_stats[i].valid = eval_libc_valid(trace, i);
-	    if (libc_stats[i].valid) {
-		speed_params.trace = trace;
-		if (verbose > 1)
-		    printf("and performance.\n");
-		libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
-	    }
-	    free_trace(trace);
-	}
+	eval_suite(eval_libc_trace, tracefiles, num_tracefiles, libc_stats, 
+		   NULL);
 
 	/* Display the libc results in a compact table */
 	if (verbose) {
@@ -274,109 +510,103 @@ int main(int argc, char **argv)
     }
 
     /*
-     * Always run and evaluate the student's mm package
+     * Always run and evaluate the selected mm packages
      */
-    if (verbose > 1)
-	printf("\nTesting mm malloc\n");
-
-    /* Allocate the mm stats array, with one stats_t struct per tracefile */
-    mm_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
-    if (mm_stats == NULL)
+    if ((mm_stats = (stats_t **)calloc(num_variants, sizeof(stats_t *))) == NULL)
 	unix_error("mm_stats calloc in main failed");
+    if (latency)
+	lat_calibrate();
     
     /* Initialize the simulated memory system in memlib.c */
     mem_init(); 
 
-    /* Evaluate student's mm malloc package using the K-best scheme */
-    for (i=0; i < num_tracefiles; i++) {
-	trace = read_trace(tracedir, tracefiles[i]);
-	mm_stats[i].ops = trace->num_ops;
+    for (v = 0; v < num_variants; v++) {
+	mm = variants[v];
+	errors = 0;
 	if (verbose > 1)
-	    printf("Checking mm_malloc for correctness, ");
-	mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
-	if (mm_stats[i].valid) {
-	    if (verbose > 1)
-		printf("efficiency, ");
-	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
-	    speed_params.trace = trace;
-	    speed_params.ranges = ranges;
-	    if (verbose > 1)
-		printf("and performance.\n");
-	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
-	}
-	free_trace(trace);
-    }
-
-    /* Display the mm results in a compact table */
-    if (verbose) {
-	printf("\nResults for mm malloc:\n");
-	printresults(num_tracefiles, mm_stats);
-	printf("\n");
-    }
+	    printf("\nTesting %s malloc\n", mm->name);
 
-    /* 
-     * Accumulate the aggregate statistics for the student's mm package 
-     */
-    secs = 0;
-    ops = 0;
-    util = 0;
-    numcorrect = 0;
-    for (i=0; i < num_tracefiles; i++) {
-	secs += mm_stats[i].secs;
-	ops += mm_stats[i].ops;
-	util += mm_stats[i].util;
-	if (mm_stats[i].valid)
-	    numcorrect++;
-    }
-    avg_mm_util = util/num_tracefiles;
+	/* Allocate the mm stats array, with one stats_t struct per tracefile */
+	mm_stats[v] = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
+	if (mm_stats[v] == NULL)
+	    unix_error("mm_stats calloc in main failed");
 
-    /* 
-     * Compute and print the performance index 
-     */
-    if (errors == 0) {
-	avg_mm_throughput = ops/secs;
+	/* One histogram for each type of request, summed over the traces */
+	if (latency) {
+	    if ((lat = (lathist_t *)calloc(3, sizeof(lathist_t))) == NULL)
+		unix_error("lat calloc in main failed");
+	}
 
-	p1 = UTIL_WEIGHT * avg_mm_util;
-	if (avg_mm_throughput > AVG_LIBC_THRUPUT) {
-	    p2 = (double)(1.0 - UTIL_WEIGHT);
-	} 
-	else {
-	    p2 = ((double) (1.0 - UTIL_WEIGHT)) * 
-		(avg_mm_throughput/AVG_LIBC_THRUPUT);
+	/* Evaluate the mm malloc package using the K-best scheme */
+	eval_suite(eval_mm_trace, tracefiles, num_tracefiles, mm_stats[v], 
+		   lat);
+
+	/* Display the mm results in a compact table */
+	if (verbose) {
+	    printf("\nResults for %s malloc:\n", mm->name);
+	    printresults(num_tracefiles, mm_stats[v]);
+	    printf("\n");
+	}
+	if (latency) {
+	    printlatency(lat);
+	    printf("\n");
+	    free(lat);
+	}
+
+	/* 
+	 * Compute and print the performance index 
+	 */
+	numcorrect = 0;
+	for (i=0; i < num_tracefiles; i++) {
+	    if (mm_stats[v][i].valid)
+		numcorrect++;
+	}
+	if (errors == 0) {
+	    perfindex = perf_index(num_tracefiles, mm_stats[v], &p1, &p2);
+	    if (num_variants > 1)
+		printf("%s: ", mm->name);
+	    printf("Perf index = %.0f (util) + %.0f (thru) = %.0f/100\n",
+		   p1*100, 
+		   p2*100, 
+		   perfindex);
+	}
+	else { /* There were errors */
+	    perfindex = 0.0;
+	    if (num_variants > 1)
+		printf("%s: ", mm->name);
+	    printf("Terminated with %d errors\n", errors);
 	}
-	
-	perfindex = (p1 + p2)*100.0;
-	printf("Perf index = %.0f (util) + %.0f (thru) = %.0f/100\n",
-	       p1*100, 
-	       p2*100, 
-	       perfindex);
-	
-    }
-    else { /* There were errors */
-	perfindex = 0.0;
-	printf("Terminated with %d errors\n", errors);
-    }
 
-    if (autograder) {
-	printf("correct:%d\n", numcorrect);
-	printf("perfidx:%.0f\n", perfindex);
+	if (autograder) {
+	    printf("correct:%d\n", numcorrect);
+	    printf("perfidx:%.0f\n", perfindex);
+	}
+	total_errors += errors;
     }
+    errors = total_errors;
+
+    /* Put the packages side by side */
+    if (num_variants > 1)
+	printcompare(num_tracefiles, num_variants, variants, mm_stats);
 
     exit(0);
 }
 
 
 /*****************************************************************
- * The following routines manipulate the range list, which keeps 
+ * The following routines manipulate the range tree, which keeps 
  * track of the extent of every allocated block payload. We use the 
- * range list to detect any overlapping allocated blocks.
+ * range tree to detect any overlapping allocated blocks. Its ranges
+ * never overlap, so ordering them by lo orders them by hi as well,
+ * and a single root-to-leaf walk finds any range that overlaps a
+ * new one.
  ****************************************************************/
 
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of 
  *     size bytes at addr lo. After checking the block for correctness,
- *     we create a range struct for this block and add it to the range list. 
+ *     we create a range struct for this block and add it to the range tree. 
  */
 static int add_range(range_t **ranges, char *lo, int size, 
 		     int tracenum, int opnum)
@@ -395,9 +625,10 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
-	(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    /* The payload must lie within the extent of the heap or of a mapping */
+    if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
+	 (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+	!mem_is_mapped(lo, size)) {
 	sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
 		lo, hi, mem_heap_lo(), mem_heap_hi());
 	malloc_error(tracenum, opnum, msg);
@@ -405,26 +636,22 @@ static int add_range(range_t **ranges, char *lo, int size,
     }
 
     /* The payload must not overlap any other payloads */
-    for (p = *ranges;  p != NULL;  p = p->next) {
-        if ((lo >= p->lo && lo <= p-> hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
-	    sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-		    lo, hi, p->lo, p->hi);
-	    malloc_error(tracenum, opnum, msg);
-	    return 0;
-        }
+    if ((p = find_overlap(*ranges, lo, hi)) != NULL) {
+	sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
+		lo, hi, p->lo, p->hi);
+	malloc_error(tracenum, opnum, msg);
+	return 0;
     }
 
     /* 
      * Everything looks OK, so remember the extent of this block 
-     * by creating a range struct and adding it the range list.
+     * by creating a range struct and adding it the range tree.
      */
     if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
 	unix_error("malloc error in add_range");
-    p->next = *ranges;
     p->lo = lo;
     p->hi = hi;
-    *ranges = p;
+    *ranges = insert_range(*ranges, p);
     return 1;
 }
 
@@ -433,19 +660,7 @@ static int add_range(range_t **ranges, char *lo, int size,
  */
 static void remove_range(range_t **ranges, char *lo)
 {
-    range_t *p;
-    range_t **prevpp = ranges;
-    int size;
-
-    for (p = *ranges;  p != NULL; p = p->next) {
-        if (p->lo == lo) {
-	    *prevpp = p->next;
-            size = p->hi - p->lo + 1;
-            free(p);
-            break;
-        }
-        prevpp = &(p->next);
-    }
+    *ranges = delete_range(*ranges, lo);
 }
 
 /*
@@ -453,33 +668,172 @@ static void remove_range(range_t **ranges, char *lo)
  */
 static void clear_ranges(range_t **ranges)
 {
-    range_t *p;
-    range_t *pnext;
+    range_t *p = *ranges;
 
-    for (p = *ranges;  p != NULL;  p = pnext) {
-        pnext = p->next;
-        free(p);
-    }
+    if (p == NULL)
+	return;
+    clear_ranges(&p->left);
+    clear_ranges(&p->right);
+    free(p);
     *ranges = NULL;
 }
 
+/*
+ * find_overlap - return a range in tree t that shares a byte with
+ *     [lo, hi], or NULL if there is none
+ */
+static range_t *find_overlap(range_t *t, char *lo, char *hi)
+{
+    while (t != NULL) {
+	if (t->hi < lo)
+	    t = t->right;
+	else if (t->lo > hi)
+	    t = t->left;
+	else
+	    return t;
+    }
+    return NULL;
+}
+
+/*
+ * insert_range - add range p to tree t and return the new root
+ */
+static range_t *insert_range(range_t *t, range_t *p)
+{
+    if (t == NULL) {
+	p->left = p->right = NULL;
+	p->height = 1;
+	return p;
+    }
+    if (p->lo < t->lo)
+	t->left = insert_range(t->left, p);
+    else
+	t->right = insert_range(t->right, p);
+    return balance_range(t);
+}
+
+/*
+ * delete_range - free the range starting at lo in tree t, if any, and
+ *     return the new root
+ */
+static range_t *delete_range(range_t *t, char *lo)
+{
+    range_t *min;
+
+    if (t == NULL)
+	return NULL;
+    if (lo < t->lo)
+	t->left = delete_range(t->left, lo);
+    else if (lo > t->lo)
+	t->right = delete_range(t->right, lo);
+    else {
+	/* replace t by its successor, or by its left subtree if none */
+	if (t->right == NULL) {
+	    min = t->left;
+	    free(t);
+	    return min;
+	}
+	t->right = delete_min_range(t->right, &min);
+	min->left = t->left;
+	min->right = t->right;
+	free(t);
+	t = min;
+    }
+    return balance_range(t);
+}
+
+/*
+ * delete_min_range - unlink the lowest range of tree t, store it in
+ *     *min, and return the new root
+ */
+static range_t *delete_min_range(range_t *t, range_t **min)
+{
+    if (t->left == NULL) {
+	*min = t;
+	return t->right;
+    }
+    t->left = delete_min_range(t->left, min);
+    return balance_range(t);
+}
+
+/*
+ * balance_range - restore the AVL property at the root of tree t,
+ *     whose subtrees are balanced, and return the new root
+ */
+static range_t *balance_range(range_t *t)
+{
+    int lh = range_height(t->left);
+    int rh = range_height(t->right);
+
+    if (lh > rh + 1) {
+	if (range_height(t->left->left) < range_height(t->left->right))
+	    t->left = rotate_range(t->left, 1);
+	return rotate_range(t, 0);
+    }
+    if (rh > lh + 1) {
+	if (range_height(t->right->right) < range_height(t->right->left))
+	    t->right = rotate_range(t->right, 0);
+	return rotate_range(t, 1);
+    }
+    t->height = (lh > rh ? lh : rh) + 1;
+    return t;
+}
+
+/*
+ * rotate_range - rotate tree t left (lifting its right child) if left
+ *     is set, else right, and return the new root
+ */
+static range_t *rotate_range(range_t *t, int left)
+{
+    range_t *c;
+    int lh, rh;
+
+    if (left) {
+	c = t->right;
+	t->right = c->left;
+	c->left = t;
+    }
+    else {
+	c = t->left;
+	t->left = c->right;
+	c->right = t;
+    }
+
+    lh = range_height(t->left);
+    rh = range_height(t->right);
+    t->height = (lh > rh ? lh : rh) + 1;
+    lh = range_height(c->left);
+    rh = range_height(c->right);
+    c->height = (lh > rh ? lh : rh) + 1;
+    return c;
+}
+
+/*
+ * range_height - height of tree t, 0 if it is empty
+ */
+static int range_height(range_t *t)
+{
+    return t == NULL ? 0 : t->height;
+}
+
 
 /**********************************************
  * The following routines manipulate tracefiles
  *********************************************/
 
 /*
- * read_trace - read a trace file and store it in memory
+ * read_trace - read a trace file and store it in memory. Binary trace
+ *     files are mapped and used in place instead (see map_trace).
  */
 static trace_t *read_trace(char *tracedir, char *filename)
 {
-    FILE *tracefile;
+    FILE *tracefile = NULL;
     trace_t *trace;
-    char type[MAXLINE];
     char path[MAXLINE];
-    unsigned index, size;
+    unsigned index;
     unsigned max_index = 0;
     unsigned op_index;
+    int fd;
 
     if (verbose > 1)
 	printf("Reading tracefile: %s\n", filename);
@@ -487,23 +841,35 @@ static trace_t *read_trace(char *tracedir, char *filename)
     /* Allocate the trace record */
     if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
 	unix_error("malloc 1 failed in read_trance");
+    trace->stream = NULL;
+    trace->pos = 0;
 	
     /* Read the trace file header */
     strcpy(path, tracedir);
     strcat(path, filename);
-    if ((tracefile = fopen(path, "r")) == NULL) {
+    if (stream_ops)
+	return open_stream(trace, path);
+    if ((fd = open(path, O_RDONLY)) < 0) {
 	sprintf(msg, "Could not open %s in read_trace", path);
 	unix_error(msg);
     }
-    fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
-    fscanf(tracefile, "%d", &(trace->num_ids));     
-    fscanf(tracefile, "%d", &(trace->num_ops));     
-    fscanf(tracefile, "%d", &(trace->weight));        /* not used */
+    if (!map_trace(trace, fd, path)) {
+	if ((tracefile = fdopen(fd, "r")) == NULL) {
+	    sprintf(msg, "Could not open %s in read_trace", path);
+	    unix_error(msg);
+	}
+	fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
+	fscanf(tracefile, "%d", &(trace->num_ids));     
+	fscanf(tracefile, "%d", &(trace->num_ops));     
+	fscanf(tracefile, "%d", &(trace->weight));        /* not used */
     
-    /* We'll store each request line in the trace in this array */
-    if ((trace->ops = 
-	 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
-	unix_error("malloc 2 failed in read_trace");
+	/* We'll store each request line in the trace in this array */
+	if ((trace->ops = 
+	     (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+	    unix_error("malloc 2 failed in read_trace");
+    }
+    else
+	close(fd);
 
     /* We'll keep an array of pointers to the allocated blocks here... */
     if ((trace->blocks = 
@@ -514,39 +880,28 @@ static trace_t *read_trace(char *tracedir, char *filename)
     if ((trace->block_sizes = 
 	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
 	unix_error("malloc 4 failed in read_trace");
+
+    /* The whole trace is replayed as a single chunk */
+    trace->count = trace->num_ops;
+
+    /* A mapped trace is already in its final form */
+    if (tracefile == NULL) {
+	trace->num_reqs = count_reqs(trace->ops, trace->num_ops);
+	return trace;
+    }
     
     /* read every request line in the trace file */
-    index = 0;
     op_index = 0;
-    while (fscanf(tracefile, "%s", type) != EOF) {
-	switch(type[0]) {
-	case 'a':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = ALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'r':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = REALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
+    while (read_op(tracefile, &trace->ops[op_index], path)) {
+	index = trace->ops[op_index].index;
+	if (trace->ops[op_index].type == ALLOC_BATCH)
+	    index += trace->ops[op_index].arg - 1;
+	if (trace->ops[op_index].type != FREE &&
+	    trace->ops[op_index].type != FREE_BATCH)
 	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'f':
-	    fscanf(tracefile, "%ud", &index);
-	    trace->ops[op_index].type = FREE;
-	    trace->ops[op_index].index = index;
-	    break;
-	default:
-	    printf("Bogus type character (%c) in tracefile %s\n", 
-		   type[0], path);
-	    exit(1);
-	}
 	op_index++;
-	
     }
+    trace->num_reqs = count_reqs(trace->ops, trace->num_ops);
     fclose(tracefile);
     assert(max_index == trace->num_ids - 1);
     assert(trace->num_ops == op_index);
@@ -554,75 +909,779 @@ static trace_t *read_trace(char *tracedir, char *filename)
     return trace;
 }
 
+/*
+ * map_trace - if fd is a binary trace file, map it read-only, point
+ *     trace->ops at the records inside the mapping and fill in the
+ *     header fields. Returns 0, with the file offset rewound, for a
+ *     text trace.
+ */
+static int map_trace(trace_t *trace, int fd, char *path)
+{
+    binhdr_t hdr;
+    struct stat st;
+    char *map;
+
+    trace->map = NULL;
+    trace->map_len = 0;
+
+    if (read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+	memcmp(hdr.magic, BIN_MAGIC, sizeof(BIN_MAGIC)) != 0) {
+	lseek(fd, 0, SEEK_SET);
+	return 0;
+    }
+
+    if (hdr.version != BIN_VERSION) {
+	sprintf(msg, "Binary trace %s has version %d, expected %d",
+		path, hdr.version, BIN_VERSION);
+	app_error(msg);
+    }
+    if (fstat(fd, &st) < 0) {
+	sprintf(msg, "Could not stat %s in map_trace", path);
+	unix_error(msg);
+    }
+    if (hdr.num_ops < 0 || hdr.num_ids < 0 || (size_t)st.st_size != 
+	sizeof(hdr) + (size_t)hdr.num_ops * sizeof(traceop_t)) {
+	sprintf(msg, "Binary trace %s is truncated or corrupt", path);
+	app_error(msg);
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+	sprintf(msg, "Could not map %s in map_trace", path);
+	unix_error(msg);
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    trace->sugg_heapsize = hdr.sugg_heapsize;
+    trace->num_ids = hdr.num_ids;
+    trace->num_ops = hdr.num_ops;
+    trace->weight = hdr.weight;
+    trace->ops = (traceop_t *)(map + sizeof(hdr));
+    trace->map = map;
+    trace->map_len = st.st_size;
+    return 1;
+}
+
+/*
+ * read_op - Read the next request line of a text trace into op.
+ *     Returns 0 at the end of the file.
+ */
+static int read_op(FILE *tracefile, traceop_t *op, char *path)
+{
+    char type[MAXLINE];
+    unsigned index, size, align, count;
+
+    if (fscanf(tracefile, "%s", type) == EOF)
+	return 0;
+    op->arg = 0;
+    switch(type[0]) {
+    case 'a':
+	fscanf(tracefile, "%u %u", &index, &size);
+	op->type = ALLOC;
+	op->index = index;
+	op->size = size;
+	break;
+    case 'c':
+	fscanf(tracefile, "%u %u", &index, &size);
+	op->type = CALLOC;
+	op->index = index;
+	op->size = size;
+	break;
+    case 'm':
+	fscanf(tracefile, "%u %u %u", &index, &size, &align);
+	if (align == 0 || (align & (align - 1)) != 0 || align > (1u << 30)) {
+	    printf("Bogus alignment (%u) in tracefile %s\n", align, path);
+	    exit(1);
+	}
+	op->type = MEMALIGN;
+	op->index = index;
+	op->size = size;
+	op->arg = align;
+	break;
+    case 'b':
+	fscanf(tracefile, "%u %u %u", &index, &size, &count);
+	op->type = ALLOC_BATCH;
+	op->index = index;
+	op->size = size;
+	op->arg = count;
+	break;
+    case 'B':
+	fscanf(tracefile, "%u %u", &index, &count);
+	op->type = FREE_BATCH;
+	op->index = index;
+	op->size = 0;
+	op->arg = count;
+	break;
+    case 'r':
+	fscanf(tracefile, "%u %u", &index, &size);
+	op->type = REALLOC;
+	op->index = index;
+	op->size = size;
+	break;
+    case 'f':
+	fscanf(tracefile, "%ud", &index);
+	op->type = FREE;
+	op->index = index;
+	break;
+    default:
+	printf("Bogus type character (%c) in tracefile %s\n", 
+	       type[0], path);
+	exit(1);
+    }
+    return 1;
+}
+
+/*
+ * count_reqs - Count the blocks allocated or freed by num_ops requests,
+ *     so that a batch of n blocks counts as n requests
+ */
+static long count_reqs(traceop_t *ops, int num_ops)
+{
+    long n = 0;
+    int i;
+
+    for (i = 0; i < num_ops; i++)
+	n += (ops[i].type == ALLOC_BATCH || ops[i].type == FREE_BATCH) ?
+	    ops[i].arg : 1;
+    return n;
+}
+
 /*
  * free_trace - Free the trace record and the three arrays it points
  *              to, all of which were allocated in read_trace().
  */
 void free_trace(trace_t *trace)
 {
-    free(trace->ops);         /* free the three arrays... */
+    if (trace->stream) {      /* close a streamed trace */
+	fclose(trace->stream->file);
+	free(trace->stream->path);
+	free(trace->stream->ids);
+	free(trace->stream->free_slots);
+	free(trace->stream);
+    }
+    if (trace->map)           /* unmap a binary trace... */
+	munmap(trace->map, trace->map_len);
+    else
+	free(trace->ops);     /* ... or free the three arrays... */
     free(trace->blocks);      
     free(trace->block_sizes);
     free(trace);              /* and the trace record itself... */
 }
 
-/**********************************************************************
- * The following functions evaluate the correctness, space utilization,
- * and throughput of the libc and mm malloc packages.
- **********************************************************************/
+/*****************************************************************
+ * The following routines stream a trace that is too large to load
+ * (-R). Only a chunk of stream_ops requests is held at a time, and
+ * the trace's ids are renumbered into slots of trace->blocks as they
+ * are decoded, so the blocks arrays grow to the most ids that are
+ * live at once rather than to num_ids.
+ ****************************************************************/
 
 /*
- * eval_mm_valid - Check the mm malloc package for correctness
+ * open_stream - Read the header of the trace at path and get it ready
+ *     to be decoded by next_chunk
  */
-static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) 
+static trace_t *open_stream(trace_t *trace, char *path)
 {
-    int i, j;
-    int index;
-    int size;
-    int oldsize;
-    char *newp;
-    char *oldp;
-    char *p;
-    
-    /* Reset the heap and free any records in the range list */
-    mem_reset_brk();
-    clear_ranges(ranges);
+    stream_t *stream;
+    binhdr_t hdr;
+    struct stat st;
+
+    if ((stream = (stream_t *)calloc(1, sizeof(stream_t))) == NULL)
+	unix_error("calloc failed in open_stream");
+    stream->path = strdup(path);
+    if ((stream->file = fopen(path, "r")) == NULL) {
+	sprintf(msg, "Could not open %s in open_stream", path);
+	unix_error(msg);
+    }
 
-    /* Call the mm package's init function */
-    if (mm_init() < 0) {
-	malloc_error(tracenum, 0, "mm_init failed.");
-	return 0;
+    if (fread(&hdr, sizeof(hdr), 1, stream->file) == 1 &&
+	memcmp(hdr.magic, BIN_MAGIC, sizeof(BIN_MAGIC)) == 0) {
+	if (hdr.version != BIN_VERSION) {
+	    sprintf(msg, "Binary trace %s has version %d, expected %d",
+		    path, hdr.version, BIN_VERSION);
+	    app_error(msg);
+	}
+	if (fstat(fileno(stream->file), &st) < 0) {
+	    sprintf(msg, "Could not stat %s in open_stream", path);
+	    unix_error(msg);
+	}
+	if (hdr.num_ops < 0 || hdr.num_ids < 0 || (size_t)st.st_size != 
+	    sizeof(hdr) + (size_t)hdr.num_ops * sizeof(traceop_t)) {
+	    sprintf(msg, "Binary trace %s is truncated or corrupt", path);
+	    app_error(msg);
+	}
+	trace->sugg_heapsize = hdr.sugg_heapsize;
+	trace->num_ids = hdr.num_ids;
+	trace->num_ops = hdr.num_ops;
+	trace->weight = hdr.weight;
+	stream->binary = 1;
+    }
+    else {
+	rewind(stream->file);
+	if (fscanf(stream->file, "%d", &(trace->sugg_heapsize)) != 1 ||
+	    fscanf(stream->file, "%d", &(trace->num_ids)) != 1 ||
+	    fscanf(stream->file, "%d", &(trace->num_ops)) != 1 ||
+	    fscanf(stream->file, "%d", &(trace->weight)) != 1 ||
+	    trace->num_ids < 0 || trace->num_ops < 0) {
+	    sprintf(msg, "Trace %s has a malformed header", path);
+	    app_error(msg);
+	}
     }
+    stream->start = ftell(stream->file);
+    trace->num_reqs = trace->num_ops;  /* batches can't be streamed */
 
-    /* Interpret each operation in the trace in order */
-    for (i = 0;  i < trace->num_ops;  i++) {
-	index = trace->ops[i].index;
-	size = trace->ops[i].size;
+    /* The chunk of decoded requests */
+    if ((trace->ops = 
+	 (traceop_t *)malloc(stream_ops * sizeof(traceop_t))) == NULL)
+	unix_error("malloc 1 failed in open_stream");
+
+    /* The live ids, mapped to their slots in blocks */
+    stream->ids_len = STREAM_IDS;
+    if ((stream->ids = 
+	 (idslot_t *)malloc(stream->ids_len * sizeof(idslot_t))) == NULL)
+	unix_error("malloc 2 failed in open_stream");
+
+    /* blocks and block_sizes are grown by stream_slot */
+    trace->blocks = NULL;
+    trace->block_sizes = NULL;
+    trace->map = NULL;
+    trace->map_len = 0;
+    trace->stream = stream;
+    rewind_trace(trace);
+    return trace;
+}
+
+/*
+ * rewind_trace - Get ready to replay a trace from its first request.
+ *     A streamed trace is decoded again from the start of the file,
+ *     with no ids live and every slot free.
+ */
+static void rewind_trace(trace_t *trace)
+{
+    stream_t *stream = trace->stream;
+    int i;
 
-        switch (trace->ops[i].type) {
+    trace->pos = 0;
+    if (stream == NULL)
+	return;
 
-        case ALLOC: /* mm_malloc */
+    trace->count = 0;
+    clearerr(stream->file);
+    if (fseek(stream->file, stream->start, SEEK_SET) < 0) {
+	sprintf(msg, "Could not rewind %s in rewind_trace", stream->path);
+	unix_error(msg);
+    }
+    for (i = 0; i < stream->ids_len; i++)
+	stream->ids[i].id = -1;
+    stream->decoded = 0;
+    stream->live = 0;
+    stream->nfree = 0;
+    stream->nslots = 0;
+    stream->decode_secs = 0;
+}
 
-	    /* Call the student's malloc */
-	    if ((p = mm_malloc(size)) == NULL) {
-		malloc_error(tracenum, i, "mm_malloc failed.");
-		return 0;
+/*
+ * next_chunk - Called by NEXT_OP once every request in trace->ops has
+ *     been replayed. Decodes the next chunk of a streamed trace into
+ *     trace->ops and returns its first request.
+ */
+static traceop_t *next_chunk(trace_t *trace)
+{
+    stream_t *stream = trace->stream;
+    double start = mt_now();
+    int i, n;
+
+    if (stream == NULL || stream->decoded == trace->num_ops)
+	app_error("Replayed past the end of the trace in next_chunk");
+
+    n = trace->num_ops - stream->decoded;
+    if (n > stream_ops)
+	n = stream_ops;
+    if (stream->binary) {
+	if (fread(trace->ops, sizeof(traceop_t), n, stream->file) != (size_t)n) {
+	    sprintf(msg, "Binary trace %s is truncated", stream->path);
+	    app_error(msg);
+	}
+    }
+    else {
+	for (i = 0; i < n; i++) {
+	    if (!read_op(stream->file, &trace->ops[i], stream->path)) {
+		sprintf(msg, "Trace %s has fewer than %d requests", 
+			stream->path, trace->num_ops);
+		app_error(msg);
 	    }
-	    
-	    /* 
-	     * Test the range of the new block for correctness and add it 
-	     * to the range list if OK. The block must be  be aligned properly,
-	     * and must not overlap any currently allocated block. 
-	     */ 
-	    if (add_range(ranges, p, size, tracenum, i) == 0)
-		return 0;
-	    
-	    /* ADDED: cgw
-	     * fill range with low byte of index.  This will be used later
-	     * if we realloc the block and wish to make sure that the old
-	     * data was copied to the new block
-	     */
-	    memset(p, index & 0xFF, size);
+	}
+    }
+    for (i = 0; i < n; i++)
+	trace->ops[i].index = stream_slot(trace, &trace->ops[i]);
+
+    stream->decoded += n;
+    stream->decode_secs += mt_now() - start;
+    trace->pos = 1;
+    trace->count = n;
+    return &trace->ops[0];
+}
+
+/*
+ * stream_slot - Look up the slot of trace->blocks for the id of a
+ *     decoded request. An allocation takes a free slot and a free gives
+ *     its slot back, which a later request in the same chunk may take
+ *     at once: the requests are replayed in the order they were decoded,
+ *     so the block is gone by then.
+ */
+static int stream_slot(trace_t *trace, traceop_t *op)
+{
+    stream_t *stream = trace->stream;
+    unsigned mask = stream->ids_len - 1;
+    unsigned i, j, k;
+    int slot;
+
+    i = ID_HASH(op->index, mask);
+    while (stream->ids[i].id != -1 && stream->ids[i].id != op->index)
+	i = (i + 1) & mask;
+
+    switch (op->type) {
+    case ALLOC:
+    case CALLOC:
+    case MEMALIGN:
+	if (stream->ids[i].id != -1) {
+	    sprintf(msg, "Id %d of %s is allocated again while live",
+		    op->index, stream->path);
+	    app_error(msg);
+	}
+	if (stream->nfree > 0)
+	    slot = stream->free_slots[--stream->nfree];
+	else {
+	    if (stream->nslots == stream->max_slots)
+		grow_slots(trace);
+	    slot = stream->nslots++;
+	}
+	stream->ids[i].id = op->index;
+	stream->ids[i].slot = slot;
+	if (++stream->live * 2 > stream->ids_len)
+	    grow_ids(stream);
+	return slot;
+
+    case REALLOC:
+    case FREE:
+	if (stream->ids[i].id == -1) {
+	    sprintf(msg, "Id %d of %s is used but not live",
+		    op->index, stream->path);
+	    app_error(msg);
+	}
+	slot = stream->ids[i].slot;
+	if (op->type == REALLOC)
+	    return slot;
+
+	/* Remove the id, moving back any later entry of its probe run
+	   that would no longer be reachable from its home position */
+	stream->free_slots[stream->nfree++] = slot;
+	stream->live--;
+	for (j = (i + 1) & mask; stream->ids[j].id != -1; j = (j + 1) & mask) {
+	    k = ID_HASH(stream->ids[j].id, mask);
+	    if ((i < j) ? (k <= i || k > j) : (k <= i && k > j)) {
+		stream->ids[i] = stream->ids[j];
+		i = j;
+	    }
+	}
+	stream->ids[i].id = -1;
+	return slot;
+
+    case ALLOC_BATCH:
+    case FREE_BATCH:
+	sprintf(msg, "Batch requests in %s can't be streamed", stream->path);
+	app_error(msg);
+
+    default:
+	sprintf(msg, "Bogus request type %d in %s", op->type, stream->path);
+	app_error(msg);
+    }
+    return -1;
+}
+
+/*
+ * grow_slots - Double the room in the blocks arrays of a streamed trace
+ */
+static void grow_slots(trace_t *trace)
+{
+    stream_t *stream = trace->stream;
+    int n = stream->max_slots ? 2 * stream->max_slots : STREAM_IDS;
+
+    if ((trace->blocks = realloc(trace->blocks, n * sizeof(char *))) == NULL ||
+	(trace->block_sizes = 
+	 realloc(trace->block_sizes, n * sizeof(size_t))) == NULL ||
+	(stream->free_slots = 
+	 realloc(stream->free_slots, n * sizeof(int))) == NULL)
+	unix_error("realloc failed in grow_slots");
+    stream->max_slots = n;
+}
+
+/*
+ * grow_ids - Double the size of the live id table
+ */
+static void grow_ids(stream_t *stream)
+{
+    idslot_t *old = stream->ids;
+    int old_len = stream->ids_len;
+    unsigned mask = 2 * old_len - 1;
+    unsigned j;
+    int i;
+
+    stream->ids_len = 2 * old_len;
+    if ((stream->ids = 
+	 (idslot_t *)malloc(stream->ids_len * sizeof(idslot_t))) == NULL)
+	unix_error("malloc failed in grow_ids");
+    for (i = 0; i < stream->ids_len; i++)
+	stream->ids[i].id = -1;
+
+    for (i = 0; i < old_len; i++) {
+	if (old[i].id == -1)
+	    continue;
+	j = ID_HASH(old[i].id, mask);
+	while (stream->ids[j].id != -1)
+	    j = (j + 1) & mask;
+	stream->ids[j] = old[i];
+    }
+    free(old);
+}
+
+/*
+ * stream_secs - Time one replay of a streamed trace by f, less the
+ *     time spent decoding it. fsecs would replay the trace several
+ *     times to find a steady figure, and count the decoding as well.
+ */
+static double stream_secs(void (*f)(void *), void *argp)
+{
+    trace_t *trace = ((speed_t *)argp)->trace;
+    double start = mt_now();
+
+    f(argp);
+    return mt_now() - start - trace->stream->decode_secs;
+}
+
+/*****************************************************************
+ * The following routines run the evaluation of each trace, either
+ * one trace after another or, with -j, in forked worker processes.
+ * A worker inherits its own copy of the memlib heap, is pinned to
+ * its own core and sends its results back through a pipe.
+ ****************************************************************/
+
+/*
+ * eval_libc_trace - Check libc malloc on one trace and time it
+ */
+static void eval_libc_trace(char *tracefile, int tracenum, stats_t *stats,
+			    lathist_t *lat)
+{
+    trace_t *trace;
+    speed_t speed_params;
+
+    trace = read_trace(tracedir, tracefile);
+    stats->ops = trace->num_reqs;
+    if (verbose > 1)
+	printf("Checking libc malloc for correctness, ");
+    stats->valid = eval_libc_valid(trace, tracenum);
+    if (stats->valid) {
+	speed_params.trace = trace;
+	if (verbose > 1)
+	    printf("and performance.\n");
+	if (trace->stream)
+	    stats->secs = stream_secs(eval_libc_speed, &speed_params);
+	else
+	    stats->secs = fsecs(eval_libc_speed, &speed_params);
+    }
+    free_trace(trace);
+}
+
+/*
+ * eval_mm_trace - Check the mm package on one trace, then measure its
+ *     utilization and speed, and its latencies if lat is not NULL
+ */
+static void eval_mm_trace(char *tracefile, int tracenum, stats_t *stats,
+			  lathist_t *lat)
+{
+    trace_t *trace;
+    range_t *ranges = NULL;
+    speed_t speed_params;
+    FILE *telemetry = NULL;
+
+    trace = read_trace(tracedir, tracefile);
+    stats->ops = trace->num_reqs;
+    if (verbose > 1)
+	printf("Checking mm_malloc for correctness, ");
+    stats->valid = eval_mm_valid(trace, tracenum, &ranges);
+    if (stats->valid) {
+	if (verbose > 1)
+	    printf("efficiency, ");
+	if (telemetry_ops)
+	    telemetry = open_telemetry(tracedir, tracefile);
+	stats->util = eval_mm_util(trace, tracenum, &ranges,
+				   &stats->reclaimed, telemetry);
+	if (telemetry)
+	    fclose(telemetry);
+	speed_params.trace = trace;
+	speed_params.ranges = ranges;
+	if (verbose > 1)
+	    printf("and performance.\n");
+	if (trace->stream)
+	    stats->secs = stream_secs(eval_mm_speed, &speed_params);
+	else
+	    stats->secs = fsecs(eval_mm_speed, &speed_params);
+
+	/* Timing each request slows the replay, so do it separately */
+	if (lat)
+	    eval_mm_latency(trace, lat);
+    }
+    clear_ranges(&ranges);
+    free_trace(trace);
+}
+
+/*
+ * eval_suite - Evaluate every trace with eval. With -j, up to jobs
+ *     traces are evaluated at once, by workers pinned in turn to the
+ *     cores this process may run on. Workers sharing a core would spoil
+ *     each other's timings, so there are never more than there are cores.
+ */
+static void eval_suite(evaltrace_t eval, char **tracefiles, 
+		       int num_tracefiles, stats_t *stats, lathist_t *lat)
+{
+    pid_t pids[MAXJOBS];     /* worker running in each slot, or 0 */
+    int fds[MAXJOBS];        /* ... the pipe its results arrive on */
+    int tracenums[MAXJOBS];  /* ... and the trace it's evaluating */
+    int cpus[CPU_SETSIZE];   /* the cores we may use */
+    int ncpus = 0;
+    int nslots = jobs;
+    int i, slot, status, next = 0, running = 0;
+    cpu_set_t allowed;
+    pid_t pid;
+
+    if (jobs == 1) {
+	for (i = 0; i < num_tracefiles; i++)
+	    eval(tracefiles[i], i, &stats[i], lat);
+	return;
+    }
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+	for (i = 0; i < CPU_SETSIZE; i++) {
+	    if (CPU_ISSET(i, &allowed))
+		cpus[ncpus++] = i;
+	}
+    }
+    if (ncpus > 0 && nslots > ncpus)
+	nslots = ncpus;
+    for (slot = 0; slot < nslots; slot++)
+	pids[slot] = 0;
+
+    /* Don't let the workers inherit output we haven't written yet */
+    fflush(stdout);
+
+    while (next < num_tracefiles || running > 0) {
+	/* Start a worker on the next trace in every free slot */
+	for (slot = 0; slot < nslots && next < num_tracefiles; slot++) {
+	    if (pids[slot] != 0)
+		continue;
+	    tracenums[slot] = next++;
+	    pids[slot] = start_worker(eval, tracefiles[tracenums[slot]], 
+				      tracenums[slot], 
+				      ncpus ? cpus[slot] : -1, 
+				      lat, &fds[slot]);
+	    running++;
+	}
+
+	/* Collect the results of the next one to finish */
+	if ((pid = wait(&status)) < 0)
+	    unix_error("wait failed in eval_suite");
+	for (slot = 0; slot < nslots && pids[slot] != pid; slot++)
+	    ;
+	if (slot == nslots)
+	    continue;
+	finish_worker(pid, status, fds[slot], tracefiles[tracenums[slot]],
+		      tracenums[slot], &stats[tracenums[slot]], lat);
+	pids[slot] = 0;
+	running--;
+    }
+}
+
+/*
+ * start_worker - Fork a worker that evaluates one trace on the given
+ *     core (any core if cpu < 0) and writes a jobresult_t to the pipe
+ *     whose read end is returned in *fd. lat is only checked for NULL.
+ */
+static pid_t start_worker(evaltrace_t eval, char *tracefile, int tracenum,
+			  int cpu, lathist_t *lat, int *fd)
+{
+    jobresult_t result;
+    cpu_set_t mask;
+    int pipefd[2];
+    char *buf = (char *)&result;
+    size_t done;
+    ssize_t n;
+    pid_t pid;
+
+    if (pipe(pipefd) < 0)
+	unix_error("pipe failed in start_worker");
+    if ((pid = fork()) < 0)
+	unix_error("fork failed in start_worker");
+    if (pid > 0) {
+	close(pipefd[1]);
+	*fd = pipefd[0];
+	return pid;
+    }
+
+    /* The worker */
+    close(pipefd[0]);
+    if (cpu >= 0) {
+	CPU_ZERO(&mask);
+	CPU_SET(cpu, &mask);
+	sched_setaffinity(0, sizeof(mask), &mask);
+    }
+    memset(&result, 0, sizeof(result));
+    errors = 0;
+    eval(tracefile, tracenum, &result.stats, lat ? result.lat : NULL);
+    result.errors = errors;
+
+    for (done = 0; done < sizeof(result); done += n) {
+	if ((n = write(pipefd[1], buf + done, sizeof(result) - done)) <= 0)
+	    unix_error("write failed in start_worker");
+    }
+    fflush(stdout);
+    _exit(0);
+}
+
+/*
+ * finish_worker - Read the results of a worker that has exited into
+ *     stats, adding its errors to ours and its latencies to lat. A
+ *     worker that died before sending them fails its trace.
+ */
+static void finish_worker(pid_t pid, int status, int fd, char *tracefile,
+			  int tracenum, stats_t *stats, lathist_t *lat)
+{
+    jobresult_t result;
+    char *buf = (char *)&result;
+    size_t done;
+    ssize_t n;
+    int i, j;
+
+    for (done = 0; done < sizeof(result); done += n) {
+	if ((n = read(fd, buf + done, sizeof(result) - done)) <= 0)
+	    break;
+    }
+    close(fd);
+
+    if (done < sizeof(result) || !WIFEXITED(status) || 
+	WEXITSTATUS(status) != 0) {
+	if (WIFSIGNALED(status))
+	    sprintf(msg, "worker %d for %s was killed by signal %d", 
+		    (int)pid, tracefile, WTERMSIG(status));
+	else
+	    sprintf(msg, "worker %d for %s exited without results", 
+		    (int)pid, tracefile);
+	malloc_error(tracenum, 0, msg);
+	stats->valid = 0;
+	return;
+    }
+
+    *stats = result.stats;
+    errors += result.errors;
+    if (lat) {
+	for (i = 0; i < 3; i++) {
+	    for (j = 0; j < LAT_BUCKETS; j++)
+		lat[i].count[j] += result.lat[i].count[j];
+	    lat[i].n += result.lat[i].n;
+	    if (result.lat[i].max > lat[i].max)
+		lat[i].max = result.lat[i].max;
+	}
+    }
+}
+
+/**********************************************************************
+ * The following functions evaluate the correctness, space utilization,
+ * and throughput of the libc and mm malloc packages.
+ **********************************************************************/
+
+/*
+ * eval_mm_valid - Check the mm malloc package for correctness
+ */
+static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) 
+{
+    traceop_t *op;
+    int i, j;
+    int index;
+    int size;
+    int oldsize;
+    char *newp;
+    char *oldp;
+    char *p;
+    
+    /* Reset the heap and free any records in the range tree */
+    mem_reset_brk();
+    clear_ranges(ranges);
+
+    /* Call the mm package's init function */
+    if (mm->init() < 0) {
+	malloc_error(tracenum, 0, "mm_init failed.");
+	return 0;
+    }
+
+    /* Interpret each operation in the trace in order */
+    rewind_trace(trace);
+    for (i = 0;  i < trace->num_ops;  i++) {
+	op = NEXT_OP(trace);
+	index = op->index;
+	size = op->size;
+
+        switch (op->type) {
+
+        case ALLOC: /* mm_malloc */
+        case CALLOC: /* mm_calloc */
+        case MEMALIGN: /* mm_memalign */
+
+	    /* Call the student's malloc, calloc or memalign */
+	    if ((op->type == CALLOC && mm->calloc == NULL) ||
+		(op->type == MEMALIGN && mm->memalign == NULL)) {
+		malloc_error(tracenum, i, op->type == CALLOC ?
+			     "mm_calloc is not provided." :
+			     "mm_memalign is not provided.");
+		return 0;
+	    }
+	    if ((p = mm_alloc_op(op)) == NULL) {
+		malloc_error(tracenum, i, op->type == ALLOC ?
+			     "mm_malloc failed." : op->type == CALLOC ?
+			     "mm_calloc failed." : "mm_memalign failed.");
+		return 0;
+	    }
+	    
+	    /* 
+	     * Test the range of the new block for correctness and add it 
+	     * to the range tree if OK. The block must be  be aligned properly,
+	     * and must not overlap any currently allocated block. 
+	     */ 
+	    if (add_range(ranges, p, size, tracenum, i) == 0)
+		return 0;
+
+	    /* A memalign block must have the alignment asked for, and a
+	       calloc block must be zero filled */
+	    if (op->type == MEMALIGN && (unsigned long)p % op->arg != 0) {
+		sprintf(msg, "mm_memalign payload address (%p) not aligned "
+			"to %d bytes", p, op->arg);
+		malloc_error(tracenum, i, msg);
+		return 0;
+	    }
+	    if (op->type == CALLOC) {
+		for (j = 0; j < size; j++) {
+		    if (p[j] != 0) {
+			malloc_error(tracenum, i, "mm_calloc did not zero "
+				     "the block");
+			return 0;
+		    }
+		}
+	    }
+	    
+	    /* ADDED: cgw
+	     * fill range with low byte of index.  This will be used later
+	     * if we realloc the block and wish to make sure that the old
+	     * data was copied to the new block
+	     */
+	    memset(p, index & 0xFF, size);
 
 	    /* Remember region */
 	    trace->blocks[index] = p;
@@ -633,15 +1692,15 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    /* Call the student's realloc */
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp, size)) == NULL) {
+	    if ((newp = mm->realloc(oldp, size)) == NULL) {
 		malloc_error(tracenum, i, "mm_realloc failed.");
 		return 0;
 	    }
 	    
-	    /* Remove the old region from the range list */
+	    /* Remove the old region from the range tree */
 	    remove_range(ranges, oldp);
 	    
-	    /* Check new block for correctness and add it to range list */
+	    /* Check new block for correctness and add it to range tree */
 	    if (add_range(ranges, newp, size, tracenum, i) == 0)
 		return 0;
 	    
@@ -653,7 +1712,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    oldsize = trace->block_sizes[index];
 	    if (size < oldsize) oldsize = size;
 	    for (j = 0; j < oldsize; j++) {
-	      if (newp[j] != (index & 0xFF)) {
+	      if ((unsigned char)newp[j] != (index & 0xFF)) {
 		malloc_error(tracenum, i, "mm_realloc did not preserve the "
 			     "data from old block");
 		return 0;
@@ -671,7 +1730,29 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    /* Remove region from list and call student's free function */
 	    p = trace->blocks[index];
 	    remove_range(ranges, p);
-	    mm_free(p);
+	    mm->free(p);
+	    break;
+
+        case ALLOC_BATCH: /* mm_malloc_batch */
+
+	    /* Every block must pass the checks of a single mm_malloc */
+	    if (mm_batch_op(op, &trace->blocks[index]) < op->arg) {
+		malloc_error(tracenum, i, "mm_malloc_batch failed.");
+		return 0;
+	    }
+	    for (j = 0; j < op->arg; j++) {
+		p = trace->blocks[index + j];
+		if (add_range(ranges, p, size, tracenum, i) == 0)
+		    return 0;
+		memset(p, (index + j) & 0xFF, size);
+		trace->block_sizes[index + j] = size;
+	    }
+	    break;
+
+        case FREE_BATCH: /* mm_free_batch */
+	    for (j = 0; j < op->arg; j++)
+		remove_range(ranges, trace->blocks[index + j]);
+	    mm_batch_op(op, &trace->blocks[index]);
 	    break;
 
 	default:
@@ -689,35 +1770,45 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  *   The idea is to remember the high water mark "hwm" of the heap for 
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the 
- *   size of the heap in bytes after running the student's malloc 
- *   package on the trace. Note that our implementation of mem_sbrk() 
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap. 
- *   
+ *   high water mark of the heap while running the student's malloc 
+ *   package on the trace. mem_sbrk() can decrement the brk pointer, so
+ *   the heap size is sampled after every request. The bytes the
+ *   package gave back that way are returned through *reclaimed.
+ *   If telemetry is not NULL, a snapshot of the heap is written to it
+ *   every telemetry_ops requests.
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   double *reclaimed, FILE *telemetry)
 {   
-    int i;
+    traceop_t *op;
+    int i, j;
     int index;
     int size, newsize, oldsize;
     int max_total_size = 0;
     int total_size = 0;
+    size_t max_heap_size = 0;
     char *p;
     char *newp, *oldp;
 
     /* initialize the heap and the mm malloc package */
     mem_reset_brk();
-    if (mm_init() < 0)
+    if (mm->init() < 0)
 	app_error("mm_init failed in eval_mm_util");
+    if (telemetry)
+	write_telemetry_header(telemetry);
 
+    rewind_trace(trace);
     for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
+	op = NEXT_OP(trace);
+        switch (op->type) {
 
         case ALLOC: /* mm_alloc */
-	    index = trace->ops[i].index;
-	    size = trace->ops[i].size;
+        case CALLOC:
+        case MEMALIGN:
+	    index = op->index;
+	    size = op->size;
 
-	    if ((p = mm_malloc(size)) == NULL) 
+	    if ((p = mm_alloc_op(op)) == NULL) 
 		app_error("mm_malloc failed in eval_mm_util");
 	    
 	    /* Remember region and size */
@@ -734,12 +1825,12 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    break;
 
 	case REALLOC: /* mm_realloc */
-	    index = trace->ops[i].index;
-	    newsize = trace->ops[i].size;
+	    index = op->index;
+	    newsize = op->size;
 	    oldsize = trace->block_sizes[index];
 
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp,newsize)) == NULL)
+	    if ((newp = mm->realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc failed in eval_mm_util");
 
 	    /* Remember region and size */
@@ -756,11 +1847,11 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    break;
 
         case FREE: /* mm_free */
-	    index = trace->ops[i].index;
+	    index = op->index;
 	    size = trace->block_sizes[index];
 	    p = trace->blocks[index];
 	    
-	    mm_free(p);
+	    mm->free(p);
 	    
 	    /* Keep track of current total size
 	     * of all allocated blocks */
@@ -768,15 +1859,127 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    break;
 
+        case ALLOC_BATCH: /* mm_malloc_batch */
+	    index = op->index;
+	    size = op->size;
+	    if (mm_batch_op(op, &trace->blocks[index]) < op->arg)
+		app_error("mm_malloc_batch failed in eval_mm_util");
+	    for (j = 0; j < op->arg; j++)
+		trace->block_sizes[index + j] = size;
+	    total_size += op->arg * size;
+	    max_total_size = (total_size > max_total_size) ?
+		total_size : max_total_size;
+	    break;
+
+        case FREE_BATCH: /* mm_free_batch */
+	    index = op->index;
+	    for (j = 0; j < op->arg; j++)
+		total_size -= trace->block_sizes[index + j];
+	    mm_batch_op(op, &trace->blocks[index]);
+	    break;
+
 	default:
 	    app_error("Nonexistent request type in eval_mm_util");
 
         }
+
+	/* The package may shrink the heap or map memory beside it, so
+	   track the high water mark of both together */
+	if (mem_heapsize() + mem_mapsize() > max_heap_size)
+	    max_heap_size = mem_heapsize() + mem_mapsize();
+
+	if (telemetry && 
+	    ((i + 1) % telemetry_ops == 0 || i == trace->num_ops - 1))
+	    write_telemetry(telemetry, i, total_size);
+    }
+
+    /* Let the package hand back whatever is free at the end of the heap */
+    if (mm->trim)
+	mm->trim(0);
+    *reclaimed = (double)mem_reclaimed();
+    return ((double)max_total_size / (double)max_heap_size);
+}
+
+
+/*
+ * open_telemetry - Create the telemetry file for a trace, next to it:
+ *     <trace without .rep>-<package>.csv
+ */
+static FILE *open_telemetry(char *tracedir, char *filename)
+{
+    char path[MAXLINE];
+    char *ext;
+    FILE *telemetry;
+
+    strcpy(path, tracedir);
+    strcat(path, filename);
+    if ((ext = strrchr(path, '.')) != NULL && strchr(ext, '/') == NULL)
+	*ext = '\0';
+    sprintf(path + strlen(path), "-%s.csv", mm->name);
+
+    if ((telemetry = fopen(path, "w")) == NULL) {
+	sprintf(msg, "Could not create %s in open_telemetry", path);
+	unix_error(msg);
     }
+    if (verbose > 1)
+	printf("writing telemetry to %s, ", path);
+    return telemetry;
+}
 
-    return ((double)max_total_size / (double)mem_heapsize());
+/*
+ * write_telemetry_header - Name the columns write_telemetry fills in.
+ *     The free-block columns stay empty for a package without
+ *     mm_heapstats, and there is one bin column per size class.
+ */
+static void write_telemetry_header(FILE *telemetry)
+{
+    mm_heapstats_t stats;
+    int i;
+
+    fprintf(telemetry, "op,heap,mapped,payload,free_blocks,free_bytes,"
+	    "largest_free,ext_frag,fast_blocks,fast_hits,fast_misses,"
+	    "consolidations");
+    if (mm->heapstats && mm->heapstats(&stats) == 0) {
+	for (i = 0; i < stats.nbins; i++)
+	    fprintf(telemetry, ",bin%d", i);
+    }
+    fprintf(telemetry, "\n");
 }
 
+/*
+ * write_telemetry - Write one row: the request number, the heap and
+ *     mapped bytes, the live payload, the free blocks and their total
+ *     and largest size, the external fragmentation (the share of free
+ *     bytes outside the largest free block), the fast-bin counters and
+ *     the free blocks in each size class.
+ */
+static void write_telemetry(FILE *telemetry, int opnum, int payload)
+{
+    mm_heapstats_t stats;
+    int i;
+
+    fprintf(telemetry, "%d,%lu,%lu,%d", opnum, 
+	    (unsigned long)mem_heapsize(), (unsigned long)mem_mapsize(), 
+	    payload);
+    if (mm->heapstats == NULL || mm->heapstats(&stats) < 0) {
+	fprintf(telemetry, ",,,,,,,,\n");
+	return;
+    }
+    fprintf(telemetry, ",%lu,%lu,%lu,%.4f", 
+	    (unsigned long)stats.free_blocks,
+	    (unsigned long)stats.free_bytes,
+	    (unsigned long)stats.largest_free,
+	    stats.free_bytes ? 
+	    1.0 - (double)stats.largest_free / stats.free_bytes : 0.0);
+    fprintf(telemetry, ",%lu,%lu,%lu,%lu",
+	    (unsigned long)stats.fast_blocks,
+	    (unsigned long)stats.fast_hits,
+	    (unsigned long)stats.fast_misses,
+	    (unsigned long)stats.consolidations);
+    for (i = 0; i < stats.nbins; i++)
+	fprintf(telemetry, ",%lu", (unsigned long)stats.bin_blocks[i]);
+    fprintf(telemetry, "\n");
+}
 
 /*
  * eval_mm_speed - This is the function that is used by fcyc()
@@ -784,45 +1987,116 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
  */
 static void eval_mm_speed(void *ptr)
 {
-    int i, index, size, newsize;
-    char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
     /* Reset the heap and initialize the mm package */
     mem_reset_brk();
-    if (mm_init() < 0) 
+    if (mm->init() < 0) 
 	app_error("mm_init failed in eval_mm_speed");
 
+    replay_mm(trace);
+}
+
+/*
+ * replay_mm - Run every request in a trace against the mm malloc
+ *    package, without checking the results.
+ */
+static void replay_mm(trace_t *trace)
+{
+    traceop_t *op;
+    int i, index, newsize;
+    char *p, *newp, *oldp, *block;
+
     /* Interpret each trace request */
-    for (i = 0;  i < trace->num_ops;  i++)
-        switch (trace->ops[i].type) {
+    rewind_trace(trace);
+    for (i = 0;  i < trace->num_ops;  i++) {
+	op = NEXT_OP(trace);
+        switch (op->type) {
 
         case ALLOC: /* mm_malloc */
-            index = trace->ops[i].index;
-            size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
-		app_error("mm_malloc error in eval_mm_speed");
+        case CALLOC:
+        case MEMALIGN:
+            index = op->index;
+            if ((p = mm_alloc_op(op)) == NULL)
+		app_error("mm_malloc error in replay_mm");
             trace->blocks[index] = p;
             break;
 
 	case REALLOC: /* mm_realloc */
-	    index = trace->ops[i].index;
-            newsize = trace->ops[i].size;
+	    index = op->index;
+            newsize = op->size;
 	    oldp = trace->blocks[index];
-            if ((newp = mm_realloc(oldp,newsize)) == NULL)
-		app_error("mm_realloc error in eval_mm_speed");
+            if ((newp = mm->realloc(oldp,newsize)) == NULL)
+		app_error("mm_realloc error in replay_mm");
             trace->blocks[index] = newp;
             break;
 
         case FREE: /* mm_free */
-            index = trace->ops[i].index;
+            index = op->index;
             block = trace->blocks[index];
-            mm_free(block);
+            mm->free(block);
+            break;
+
+        case ALLOC_BATCH: /* mm_malloc_batch */
+            if (mm_batch_op(op, &trace->blocks[op->index]) < op->arg)
+		app_error("mm_malloc_batch error in replay_mm");
+            break;
+
+        case FREE_BATCH: /* mm_free_batch */
+            mm_batch_op(op, &trace->blocks[op->index]);
             break;
 
 	default:
-	    app_error("Nonexistent request type in eval_mm_valid");
+	    app_error("Nonexistent request type in replay_mm");
         }
+    }
+}
+
+/*
+ * mm_alloc_op - Serve an ALLOC, CALLOC or MEMALIGN request with the mm
+ *    malloc package
+ */
+static inline char *mm_alloc_op(traceop_t *op)
+{
+    switch (op->type) {
+    case CALLOC:
+	if (mm->calloc == NULL)
+	    app_error("The mm package has no mm_calloc");
+	return mm->calloc(1, op->size);
+    case MEMALIGN:
+	if (mm->memalign == NULL)
+	    app_error("The mm package has no mm_memalign");
+	return mm->memalign(op->arg, op->size);
+    default:
+	return mm->malloc(op->size);
+    }
+}
+
+/*
+ * mm_batch_op - Serve an ALLOC_BATCH or FREE_BATCH request on the
+ *    blocks starting at blocks with the mm malloc package, one block
+ *    at a time if it has no batch calls. Returns the blocks allocated.
+ */
+static inline int mm_batch_op(traceop_t *op, char **blocks)
+{
+    int i;
+
+    if (op->type == ALLOC_BATCH) {
+	if (mm->malloc_batch)
+	    return mm->malloc_batch(op->size, op->arg, (void **)blocks);
+	for (i = 0; i < op->arg; i++) {
+	    if ((blocks[i] = mm->malloc(op->size)) == NULL)
+		break;
+	}
+	return i;
+    }
+    if (mm->free_batch)
+	mm->free_batch((void **)blocks, op->arg);
+    else {
+	for (i = 0; i < op->arg; i++)
+	    mm->free(blocks[i]);
+    }
+    return 0;
 }
 
 /*
@@ -833,32 +2107,42 @@ static void eval_mm_speed(void *ptr)
  */
 static int eval_libc_valid(trace_t *trace, int tracenum)
 {
+    traceop_t *op;
     int i, newsize;
     char *p, *newp, *oldp;
 
+    rewind_trace(trace);
     for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
+	op = NEXT_OP(trace);
+        switch (op->type) {
 
         case ALLOC: /* malloc */
-	    if ((p = malloc(trace->ops[i].size)) == NULL) {
+        case CALLOC: /* calloc */
+        case MEMALIGN: /* posix_memalign */
+	    if ((p = libc_alloc_op(op)) == NULL) {
 		malloc_error(tracenum, i, "libc malloc failed");
 		unix_error("System message");
 	    }
-	    trace->blocks[trace->ops[i].index] = p;
+	    trace->blocks[op->index] = p;
 	    break;
 
 	case REALLOC: /* realloc */
-            newsize = trace->ops[i].size;
-	    oldp = trace->blocks[trace->ops[i].index];
+            newsize = op->size;
+	    oldp = trace->blocks[op->index];
 	    if ((newp = realloc(oldp, newsize)) == NULL) {
 		malloc_error(tracenum, i, "libc realloc failed");
 		unix_error("System message");
 	    }
-	    trace->blocks[trace->ops[i].index] = newp;
+	    trace->blocks[op->index] = newp;
 	    break;
 	    
         case FREE: /* free */
-	    free(trace->blocks[trace->ops[i].index]);
+	    free(trace->blocks[op->index]);
+	    break;
+
+        case ALLOC_BATCH: /* malloc, n times */
+        case FREE_BATCH: /* free, n times */
+	    libc_batch_op(op, &trace->blocks[op->index]);
 	    break;
 
 	default:
@@ -876,24 +2160,28 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
  */
 static void eval_libc_speed(void *ptr)
 {
+    traceop_t *op;
     int i;
-    int index, size, newsize;
+    int index, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
+    rewind_trace(trace);
     for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
+	op = NEXT_OP(trace);
+        switch (op->type) {
         case ALLOC: /* malloc */
-	    index = trace->ops[i].index;
-	    size = trace->ops[i].size;
-	    if ((p = malloc(size)) == NULL)
+        case CALLOC:
+        case MEMALIGN:
+	    index = op->index;
+	    if ((p = libc_alloc_op(op)) == NULL)
 		unix_error("malloc failed in eval_libc_speed");
 	    trace->blocks[index] = p;
 	    break;
 
 	case REALLOC: /* realloc */
-	    index = trace->ops[i].index;
-	    newsize = trace->ops[i].size;
+	    index = op->index;
+	    newsize = op->size;
 	    oldp = trace->blocks[index];
 	    if ((newp = realloc(oldp, newsize)) == NULL)
 		unix_error("realloc failed in eval_libc_speed\n");
@@ -902,19 +2190,452 @@ static void eval_libc_speed(void *ptr)
 	    break;
 	    
         case FREE: /* free */
-	    index = trace->ops[i].index;
+	    index = op->index;
 	    block = trace->blocks[index];
 	    free(block);
 	    break;
+
+        case ALLOC_BATCH:
+        case FREE_BATCH:
+	    libc_batch_op(op, &trace->blocks[op->index]);
+	    break;
 	}
     }
 }
 
+/*
+ * libc_alloc_op - Serve an ALLOC, CALLOC or MEMALIGN request with the
+ *    libc malloc package
+ */
+static inline char *libc_alloc_op(traceop_t *op)
+{
+    void *p;
+
+    switch (op->type) {
+    case CALLOC:
+	return calloc(1, op->size);
+    case MEMALIGN:
+	if (posix_memalign(&p, op->arg < sizeof(void *) ? sizeof(void *) :
+			   op->arg, op->size) != 0)
+	    return NULL;
+	return p;
+    default:
+	return malloc(op->size);
+    }
+}
+
+/*
+ * libc_batch_op - Serve an ALLOC_BATCH or FREE_BATCH request with the
+ *    libc malloc package, which has no batch calls
+ */
+static inline void libc_batch_op(traceop_t *op, char **blocks)
+{
+    int i;
+
+    for (i = 0; i < op->arg; i++) {
+	if (op->type == FREE_BATCH)
+	    free(blocks[i]);
+	else if ((blocks[i] = malloc(op->size)) == NULL)
+	    unix_error("libc malloc failed in libc_batch_op");
+    }
+}
+
+/*
+ * eval_mm_latency - Replay a trace against the mm malloc package,
+ *     timing every request with the cycle counter, and add the times
+ *     to the histogram for the request's type.
+ */
+static void eval_mm_latency(trace_t *trace, lathist_t *hist)
+{
+    traceop_t *op;
+    int i, n, index, size;
+    char *p;
+    unsigned long long t0, t1;
+
+    /* Reset the heap and initialize the mm package */
+    mem_reset_brk();
+    if (mm->init() < 0) 
+	app_error("mm_init failed in eval_mm_latency");
+
+    rewind_trace(trace);
+    for (i = 0;  i < trace->num_ops;  i++) {
+	op = NEXT_OP(trace);
+	index = op->index;
+	size = op->size;
+        switch (op->type) {
+
+        case ALLOC: /* mm_malloc */
+        case CALLOC:
+        case MEMALIGN:
+	    t0 = read_counter();
+	    p = mm_alloc_op(op);
+	    t1 = read_counter();
+            if (p == NULL)
+		app_error("mm_malloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            break;
+
+	case REALLOC: /* mm_realloc */
+	    t0 = read_counter();
+	    p = mm->realloc(trace->blocks[index], size);
+	    t1 = read_counter();
+            if (p == NULL)
+		app_error("mm_realloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            break;
+
+        case FREE: /* mm_free */
+	    t0 = read_counter();
+            mm->free(trace->blocks[index]);
+	    t1 = read_counter();
+            break;
+
+        case ALLOC_BATCH: /* mm_malloc_batch */
+        case FREE_BATCH: /* mm_free_batch */
+	    t0 = read_counter();
+	    n = mm_batch_op(op, &trace->blocks[index]);
+	    t1 = read_counter();
+            if (op->type == ALLOC_BATCH && n < op->arg)
+		app_error("mm_malloc_batch error in eval_mm_latency");
+
+	    /* Each block is charged an equal share of the batch, and
+	       the counter overhead is only taken off once */
+	    t1 = (t1 - t0 > lat_overhead) ? t1 - t0 - lat_overhead : 0;
+	    for (n = 0; n < op->arg; n++)
+		lat_record(&hist[op->type == ALLOC_BATCH ? ALLOC : FREE],
+			   t1 / op->arg + lat_overhead);
+	    continue;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_latency");
+        }
+	/* calloc and memalign requests count as mallocs */
+	lat_record(&hist[op->type == FREE || op->type == REALLOC ?
+			 op->type : ALLOC], t1 - t0);
+    }
+}
+
+/*
+ * lat_calibrate - Find the smallest interval two back-to-back counter
+ *     reads report. lat_record takes it off every sample, so that the
+ *     histograms hold the time spent in the package alone.
+ */
+static void lat_calibrate(void)
+{
+    unsigned long long t0, t1, min = ~0ULL;
+    int i;
+
+    for (i = 0; i < LAT_CALIBRATE; i++) {
+	t0 = read_counter();
+	t1 = read_counter();
+	if (t1 - t0 < min)
+	    min = t1 - t0;
+    }
+    lat_overhead = min;
+}
+
+/*
+ * lat_record - Add one request that took t ticks to a histogram
+ */
+static void lat_record(lathist_t *hist, unsigned long long t)
+{
+    t = (t > lat_overhead) ? t - lat_overhead : 0;
+    hist->count[lat_bucket(t)]++;
+    hist->n++;
+    if (t > hist->max)
+	hist->max = t;
+}
+
+/*
+ * lat_bucket - Map t to its bucket. Values below 1 << LAT_SUB_BITS
+ *     get a bucket each; every larger power of two is split into
+ *     1 << LAT_SUB_BITS equal buckets, so a bucket is never more than
+ *     25% wider than the values in it.
+ */
+static int lat_bucket(unsigned long long t)
+{
+    int b;
+
+    if (t < (1 << LAT_SUB_BITS))
+	return (int)t;
+    b = 63 - __builtin_clzll(t);
+    return ((b - LAT_SUB_BITS + 1) << LAT_SUB_BITS) +
+	(int)((t >> (b - LAT_SUB_BITS)) & ((1 << LAT_SUB_BITS) - 1));
+}
+
+/*
+ * lat_bucket_top - Return the largest value that falls in bucket i
+ */
+static unsigned long long lat_bucket_top(int i)
+{
+    int shift;
+
+    if (i < (1 << LAT_SUB_BITS))
+	return i;
+    shift = (i >> LAT_SUB_BITS) - 1;
+    return ((((1ULL << LAT_SUB_BITS) + (i & ((1 << LAT_SUB_BITS) - 1)) + 1)
+	     << shift) - 1);
+}
+
+/*
+ * lat_percentile - Return an upper bound on the p'th quantile
+ *     (0 < p <= 1) of a histogram, or 0 if it is empty
+ */
+static unsigned long long lat_percentile(lathist_t *hist, double p)
+{
+    unsigned long rank, seen = 0;
+    unsigned long long top;
+    int i;
+
+    if (hist->n == 0)
+	return 0;
+    rank = (unsigned long)(p * hist->n);
+    if (rank < p * hist->n || rank == 0)
+	rank++;
+    for (i = 0; i < LAT_BUCKETS; i++) {
+	seen += hist->count[i];
+	if (seen >= rank)
+	    break;
+    }
+    top = lat_bucket_top(i);
+    return (top < hist->max) ? top : hist->max;
+}
+
+/**********************************************************************
+ * The following functions replay traces on several threads at once,
+ * to measure how a thread-safe mm package scales across cores. Every
+ * thread replays its own copy of a trace against the one shared heap.
+ **********************************************************************/
+
+/*
+ * eval_mt - Check each trace for correctness on one thread, then print
+ *     the aggregate and per-thread throughput of 1..nthreads threads.
+ *     Thread i replays trace i modulo the number of traces.
+ */
+static void eval_mt(char **tracefiles, int num_tracefiles, int nthreads,
+		    int run_libc)
+{
+    trace_t *traces[MT_MAXTHREADS];
+    range_t *ranges = NULL;
+    double mm_kops[MT_MAXTHREADS], libc_kops[MT_MAXTHREADS];
+    double mm_base = 0, libc_base = 0, mm_agg, libc_agg = 0;
+    int ntraces = (num_tracefiles < nthreads) ? num_tracefiles : nthreads;
+    int i, n, sugg = 0;
+    size_t heapsize;
+
+    for (i = 0; i < ntraces; i++) {
+	traces[i] = read_trace(tracedir, tracefiles[i]);
+	if (traces[i]->sugg_heapsize > sugg)
+	    sugg = traces[i]->sugg_heapsize;
+    }
+
+    /* Every thread's copy of a trace is live in the one heap at once */
+    heapsize = (size_t)nthreads * sugg;
+    mem_set_max_heap((heapsize > heap_limit) ? heapsize : heap_limit);
+    mem_init();
+    for (i = 0; i < ntraces; i++) {
+	if (!eval_mm_valid(traces[i], i, &ranges)) {
+	    printf("Trace %s is not handled correctly, skipping -T\n",
+		   tracefiles[i]);
+	    mem_deinit();
+	    mem_set_max_heap(heap_limit);
+	    return;
+	}
+    }
+
+    printf("\nReplaying %d trace%s against %s on 1..%d threads (best of %d):\n",
+	   ntraces, (ntraces > 1) ? "s" : "", mm->name, nthreads, MT_REPS);
+    printf("%7s%10s%8s", "threads", "mm Kops", "scale");
+    if (run_libc)
+	printf("%11s%8s", "libc Kops", "scale");
+    printf("  %s\n", "mm Kops per thread");
+
+    for (n = 1; n <= nthreads; n++) {
+	mm_agg = eval_mt_speed(traces, ntraces, n, 0, mm_kops);
+	if (n == 1)
+	    mm_base = mm_agg;
+	printf("%7d%10.0f%7.2fx", n, mm_agg, mm_agg / mm_base);
+	if (run_libc) {
+	    libc_agg = eval_mt_speed(traces, ntraces, n, 1, libc_kops);
+	    if (n == 1)
+		libc_base = libc_agg;
+	    printf("%11.0f%7.2fx", libc_agg, libc_agg / libc_base);
+	}
+	printf(" ");
+	for (i = 0; i < n; i++)
+	    printf(" %.0f", mm_kops[i]);
+	printf("\n");
+    }
+
+    for (i = 0; i < ntraces; i++)
+	free_trace(traces[i]);
+    mem_deinit();
+    mem_set_max_heap(heap_limit);
+}
+
+/*
+ * eval_mt_speed - Replay the traces on nthreads threads, MT_REPS
+ *     times, and return the best aggregate throughput in Kops. The
+ *     matching per-thread throughputs are stored in thread_kops.
+ */
+static double eval_mt_speed(trace_t **traces, int ntraces, int nthreads,
+			    int libc, double *thread_kops)
+{
+    mtarg_t args[MT_MAXTHREADS];
+    pthread_t tids[MT_MAXTHREADS];
+    pthread_barrier_t start;
+    double begin = 0, end = 0, ops, kops, best = 0;
+    int i, rep;
+
+    for (rep = 0; rep < MT_REPS; rep++) {
+	if (!libc) {
+	    mem_reset_brk();
+	    if (mm->init() < 0)
+		app_error("mm_init failed in eval_mt_speed");
+	}
+
+	pthread_barrier_init(&start, NULL, nthreads);
+	for (i = 0; i < nthreads; i++) {
+	    args[i].trace = *traces[i % ntraces];
+	    if ((args[i].trace.blocks =
+		 malloc(args[i].trace.num_ids * sizeof(char *))) == NULL)
+		unix_error("malloc failed in eval_mt_speed");
+	    args[i].libc = libc;
+	    args[i].start = &start;
+	    if (pthread_create(&tids[i], NULL, mt_thread, &args[i]) != 0)
+		app_error("pthread_create failed in eval_mt_speed");
+	}
+
+	/* The run lasts from the first thread's start to the last's end */
+	ops = 0;
+	for (i = 0; i < nthreads; i++) {
+	    pthread_join(tids[i], NULL);
+	    if (i == 0 || args[i].begin < begin)
+		begin = args[i].begin;
+	    if (i == 0 || args[i].end > end)
+		end = args[i].end;
+	    ops += args[i].trace.num_reqs;
+	    free(args[i].trace.blocks);
+	}
+	pthread_barrier_destroy(&start);
+
+	kops = (ops / 1e3) / (end - begin);
+	if (kops > best) {
+	    best = kops;
+	    for (i = 0; i < nthreads; i++)
+		thread_kops[i] = (args[i].trace.num_reqs / 1e3) /
+		    (args[i].end - args[i].begin);
+	}
+    }
+    return best;
+}
+
+/*
+ * mt_thread - Body of one replay thread: wait for the others, then
+ *     replay the thread's trace and note when it started and finished.
+ */
+static void *mt_thread(void *ptr)
+{
+    mtarg_t *arg = ptr;
+    speed_t speed_params;
+
+    pthread_barrier_wait(arg->start);
+    arg->begin = mt_now();
+    if (arg->libc) {
+	speed_params.trace = &arg->trace;
+	eval_libc_speed(&speed_params);
+    }
+    else
+	replay_mm(&arg->trace);
+    arg->end = mt_now();
+    return NULL;
+}
+
+/*
+ * mt_now - Wall-clock time in seconds, shared by all threads
+ */
+static double mt_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
 /*************************************
  * Some miscellaneous helper routines
  ************************************/
 
 
+/*
+ * select_variants - Look up the comma-separated mm package names, or
+ *     every package for "all", or the default package if names is
+ *     NULL. Returns the number of packages stored in variants.
+ */
+static int select_variants(char *names, mm_variant_t **variants)
+{
+    mm_variant_t *variant;
+    char *name;
+    int n = 0;
+
+    if (names == NULL) {
+	variants[0] = &mm_variants[0];
+	return 1;
+    }
+    if (!strcmp(names, "all")) {
+	for (variant = mm_variants; variant->name != NULL; variant++) {
+	    if (n < MAXVARIANTS)
+		variants[n++] = variant;
+	}
+	return n;
+    }
+
+    for (name = strtok(names, ","); name != NULL; name = strtok(NULL, ",")) {
+	if ((variant = mm_find_variant(name)) == NULL) {
+	    fprintf(stderr, "Unknown mm package %s. Choose from:", name);
+	    for (variant = mm_variants; variant->name != NULL; variant++)
+		fprintf(stderr, " %s", variant->name);
+	    fprintf(stderr, "\n");
+	    exit(1);
+	}
+	if (n == MAXVARIANTS)
+	    app_error("Too many mm packages selected with -s");
+	variants[n++] = variant;
+    }
+    if (n == 0)
+	app_error("No mm package selected with -s");
+    return n;
+}
+
+/*
+ * perf_index - Compute the performance index of one package from its
+ *     results on every trace, along with its utilization (p1) and
+ *     throughput (p2) components
+ */
+static double perf_index(int n, stats_t *stats, double *p1, double *p2)
+{
+    double secs = 0, ops = 0, util = 0, avg_util, avg_throughput;
+    int i;
+
+    for (i=0; i < n; i++) {
+	secs += stats[i].secs;
+	ops += stats[i].ops;
+	util += stats[i].util;
+    }
+    avg_util = util/n;
+    avg_throughput = ops/secs;
+
+    *p1 = UTIL_WEIGHT * avg_util;
+    if (avg_throughput > AVG_LIBC_THRUPUT) {
+	*p2 = (double)(1.0 - UTIL_WEIGHT);
+    } 
+    else {
+	*p2 = ((double) (1.0 - UTIL_WEIGHT)) * 
+	    (avg_throughput/AVG_LIBC_THRUPUT);
+    }
+    return (*p1 + *p2)*100.0;
+}
+
 /*
  * printresults - prints a performance summary for some malloc package
  */
@@ -924,54 +2645,142 @@ static void printresults(int n, stats_t *stats)
     double secs = 0;
     double ops = 0;
     double util = 0;
+    double reclaimed = 0;
 
     /* Print the individual results for each trace */
-    printf("%5s%7s %5s%8s%10s%6s\n", 
-	   "trace", " valid", "util", "ops", "secs", "Kops");
+    printf("%5s%7s %5s%8s%10s%6s%8s\n", 
+	   "trace", " valid", "util", "ops", "secs", "Kops", "trimKB");
     for (i=0; i < n; i++) {
 	if (stats[i].valid) {
-	    printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f\n", 
+	    printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f%8.0f\n", 
 		   i,
 		   "yes",
 		   stats[i].util*100.0,
 		   stats[i].ops,
 		   stats[i].secs,
-		   (stats[i].ops/1e3)/stats[i].secs);
+		   (stats[i].ops/1e3)/stats[i].secs,
+		   stats[i].reclaimed/1024);
 	    secs += stats[i].secs;
 	    ops += stats[i].ops;
 	    util += stats[i].util;
+	    reclaimed += stats[i].reclaimed;
 	}
 	else {
-	    printf("%2d%10s%6s%8s%10s%6s\n", 
+	    printf("%2d%10s%6s%8s%10s%6s%8s\n", 
 		   i,
 		   "no",
 		   "-",
 		   "-",
 		   "-",
+		   "-",
 		   "-");
 	}
     }
 
     /* Print the aggregate results for the set of traces */
     if (errors == 0) {
-	printf("%12s%5.0f%%%8.0f%10.6f%6.0f\n", 
+	printf("%12s%5.0f%%%8.0f%10.6f%6.0f%8.0f\n", 
 	       "Total       ",
 	       (util/n)*100.0,
 	       ops, 
 	       secs,
-	       (ops/1e3)/secs);
+	       (ops/1e3)/secs,
+	       reclaimed/1024);
     }
     else {
-	printf("%12s%6s%8s%10s%6s\n", 
+	printf("%12s%6s%8s%10s%6s%8s\n", 
 	       "Total       ",
 	       "-", 
 	       "-", 
 	       "-", 
+	       "-",
 	       "-");
     }
 
 }
 
+/*
+ * printcompare - prints the utilization and throughput of several
+ *     malloc packages side by side, one column pair per package
+ */
+static void printcompare(int n, int num_variants, mm_variant_t **variants,
+			 stats_t **stats)
+{
+    double p1, p2, ops, secs, util;
+    int i, v;
+
+    printf("\nSide by side:\n%5s ", "trace");
+    for (v = 0; v < num_variants; v++)
+	printf("%14.14s", variants[v]->name);
+    printf("\n%5s ", "");
+    for (v = 0; v < num_variants; v++)
+	printf("%6s%8s", "util", "Kops");
+    printf("\n");
+
+    for (i=0; i < n; i++) {
+	printf("%2d    ", i);
+	for (v = 0; v < num_variants; v++) {
+	    if (stats[v][i].valid)
+		printf("%5.0f%%%8.0f", stats[v][i].util*100.0,
+		       (stats[v][i].ops/1e3)/stats[v][i].secs);
+	    else
+		printf("%6s%8s", "-", "-");
+	}
+	printf("\n");
+    }
+
+    printf("%-6s", "Total");
+    for (v = 0; v < num_variants; v++) {
+	ops = secs = util = 0;
+	for (i=0; i < n; i++) {
+	    if (!stats[v][i].valid)
+		break;
+	    ops += stats[v][i].ops;
+	    secs += stats[v][i].secs;
+	    util += stats[v][i].util;
+	}
+	if (i == n)
+	    printf("%5.0f%%%8.0f", (util/n)*100.0, (ops/1e3)/secs);
+	else
+	    printf("%6s%8s", "-", "-");
+    }
+    printf("\n%-6s", "Perf");
+    for (v = 0; v < num_variants; v++) {
+	for (i=0; i < n && stats[v][i].valid; i++)
+	    ;
+	if (i == n)
+	    printf("%14.0f", perf_index(n, stats[v], &p1, &p2));
+	else
+	    printf("%14s", "-");
+    }
+    printf("\n");
+}
+
+/*
+ * printlatency - prints the latency percentiles of each type of
+ *     request, in counter ticks
+ */
+static void printlatency(lathist_t *hist)
+{
+    static char *names[] = {"malloc", "free", "realloc"};
+    int i;
+
+    printf("Latency of mm requests in ticks (counter overhead of %llu removed):\n",
+	   lat_overhead);
+    printf("%-8s%10s%8s%8s%8s%8s%10s\n",
+	   "request", "count", "p50", "p90", "p99", "p99.9", "max");
+    for (i = 0; i < 3; i++) {
+	printf("%-8s%10lu%8llu%8llu%8llu%8llu%10llu\n",
+	       names[i],
+	       hist[i].n,
+	       lat_percentile(&hist[i], 0.5),
+	       lat_percentile(&hist[i], 0.9),
+	       lat_percentile(&hist[i], 0.99),
+	       lat_percentile(&hist[i], 0.999),
+	       hist[i].max);
+    }
+}
+
 /* 
  * app_error - Report an arbitrary application error
  */
@@ -1004,14 +2813,22 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValL] [-f <file>] [-t <dir>] [-j <n>] [-m <MB>] [-s <names>] [-R <n>] [-S <n>] [-T <n>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-j <n>     Evaluate <n> traces at once, each on its own core.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-L         Print latency percentiles of each mm request.\n");
+    fprintf(stderr, "\t-m <MB>    Reserve <MB> megabytes for the heap (default %d).\n",
+	    MAX_HEAP >> 20);
+    fprintf(stderr, "\t-R <n>     Stream the traces <n> requests at a time instead of loading them.\n");
+    fprintf(stderr, "\t-s <names> Evaluate these mm packages (comma-separated, or all).\n");
+    fprintf(stderr, "\t-S <n>     Write heap telemetry every <n> ops to <trace>-<package>.csv.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T <n>     Replay on 1..<n> threads (thread-safe packages only).\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
 }
@@ -3,6 +3,7 @@
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
  */
+#define _GNU_SOURCE  /* mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -14,24 +15,59 @@
 #include "memlib.h"
 #include "config.h"
 
+/* Pages are made accessible in steps of at least this many bytes */
+#define COMMIT_CHUNK (1 << 16)
+
+/* Initial room in the table of mappings, a page's worth */
+#define MAPS_CHUNK 256
+
+/* A mapping handed out by mem_map */
+typedef struct {
+    char *addr;
+    size_t size;
+} mem_region_t;
+
+/* private functions */
+static int mem_commit(char *hi);
+static void mem_release(char *lo, char *hi);
+static mem_region_t *mem_find_map(void *p);
+static int mem_map_slot(char *p);
+
 /* private variables */
 static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */ 
+static char *mem_commit_brk; /* end of the pages mapped read/write */
+static char *mem_fresh_brk;  /* heap from here up has never been handed out
+				since its pages were last zero filled */
+static size_t mem_max_size = MAX_HEAP; /* bytes of address space to reserve */
+static size_t mem_released;  /* bytes given back by shrinking the heap */
+static mem_region_t *mem_maps; /* live mappings from mem_map, by address */
+static int mem_nmaps;        /* number of live mappings */
+static int mem_maxmaps;      /* room in mem_maps */
+static size_t mem_mapped;    /* total bytes in live mappings */
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-	fprintf(stderr, "mem_init_vm: malloc error\n");
+    size_t pagesize = mem_pagesize();
+    size_t size = (mem_max_size + pagesize - 1) & ~(pagesize - 1);
+
+    /* reserve the address space we will use to model the available VM;
+       pages become usable only as mem_sbrk commits them */
+    mem_start_brk = mmap(NULL, size, PROT_NONE,
+			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem_start_brk == MAP_FAILED) {
+	fprintf(stderr, "mem_init_vm: mmap error\n");
 	exit(1);
     }
 
-    mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
-    mem_brk = mem_start_brk;                  /* heap is empty initially */
+    mem_max_addr = mem_start_brk + size;  /* max legal heap address */
+    mem_brk = mem_start_brk;              /* heap is empty initially */
+    mem_commit_brk = mem_start_brk;       /* nothing committed yet */
+    mem_fresh_brk = mem_start_brk;        /* and nothing dirtied */
 }
 
 /* 
@@ -39,35 +75,105 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    munmap(mem_start_brk, mem_max_addr - mem_start_brk);
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_set_max_heap - set the bytes of address space the next mem_init
+ *    reserves for the heap (MAX_HEAP by default)
+ */
+void mem_set_max_heap(size_t size)
+{
+    mem_max_size = size;
+}
+
+/*
+ * mem_reset_brk - reset the simulated brk pointer to make an empty heap.
+ *    Committed pages stay mapped so that repeated runs don't fault them in
+ *    again.
  */
 void mem_reset_brk()
 {
     mem_brk = mem_start_brk;
+    mem_released = 0;
+
+    /* mappings belong to the heap being thrown away */
+    while (mem_nmaps > 0)
+	mem_unmap(mem_maps[mem_nmaps - 1].addr, mem_maps[mem_nmaps - 1].size);
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area. A
+ *    negative incr shrinks the heap, and the whole pages it releases
+ *    are handed back to the kernel.
  */
 void *mem_sbrk(int incr) 
 {
     char *old_brk = mem_brk;
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    if ((mem_brk + incr) > mem_max_addr) {
 	errno = ENOMEM;
 	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 	return (void *)-1;
     }
+    if ((mem_brk + incr) < mem_start_brk) {
+	errno = EINVAL;
+	fprintf(stderr, "ERROR: mem_sbrk failed. Shrunk below the heap start...\n");
+	return (void *)-1;
+    }
+    if ((mem_brk + incr) > mem_commit_brk && mem_commit(mem_brk + incr) < 0) {
+	errno = ENOMEM;
+	fprintf(stderr, "ERROR: mem_sbrk failed. Could not commit memory...\n");
+	return (void *)-1;
+    }
     mem_brk += incr;
+    if (incr < 0)
+	mem_release(mem_brk, old_brk);
+    else if (mem_brk > mem_fresh_brk)
+	mem_fresh_brk = mem_brk;
     return (void *)old_brk;
 }
 
+/*
+ * mem_commit - make the reserved pages up to hi readable and writable
+ */
+static int mem_commit(char *hi)
+{
+    size_t size = hi - mem_commit_brk;
+
+    size = (size + COMMIT_CHUNK - 1) & ~(size_t)(COMMIT_CHUNK - 1);
+
+    if (size > (size_t)(mem_max_addr - mem_commit_brk))
+	size = mem_max_addr - mem_commit_brk;
+    if (mprotect(mem_commit_brk, size, PROT_READ | PROT_WRITE) < 0)
+	return -1;
+    mem_commit_brk += size;
+    return 0;
+}
+
+/*
+ * mem_release - drop and decommit the pages from the one holding lo
+ *    onwards, so they no longer count against the resident size. hi is
+ *    the old brk.
+ */
+static void mem_release(char *lo, char *hi)
+{
+    size_t pagesize = mem_pagesize();
+    char *first = (char *)(((size_t)lo + pagesize - 1) & ~(pagesize - 1));
+
+    mem_released += hi - lo;
+    if (first < mem_commit_brk) {
+	madvise(first, mem_commit_brk - first, MADV_DONTNEED);
+	mprotect(first, mem_commit_brk - first, PROT_NONE);
+	mem_commit_brk = first;
+    }
+
+    /* dropped pages read back as zeros */
+    if (first < mem_fresh_brk)
+	mem_fresh_brk = first;
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -84,6 +190,17 @@ void *mem_heap_hi()
     return (void *)(mem_brk - 1);
 }
 
+/*
+ * mem_fresh_lo - return the lowest heap address from which on the heap
+ *    holds only zeros: nothing above it has been handed out by mem_sbrk
+ *    since its pages were last zero filled. Pages that mem_reset_brk
+ *    keeps are not zeroed, so they stay below it.
+ */
+void *mem_fresh_lo()
+{
+    return (void *)mem_fresh_brk;
+}
+
 /*
  * mem_heapsize() - returns the heap size in bytes
  */
@@ -92,6 +209,14 @@ size_t mem_heapsize()
     return (size_t)(mem_brk - mem_start_brk);
 }
 
+/*
+ * mem_max_heap() - returns the largest size the heap can grow to
+ */
+size_t mem_max_heap()
+{
+    return (size_t)(mem_max_addr - mem_start_brk);
+}
+
 /*
  * mem_pagesize() - returns the page size of the system
  */
@@ -99,3 +224,159 @@ size_t mem_pagesize()
 {
     return (size_t)getpagesize();
 }
+
+/*
+ * mem_reclaimed() - returns the bytes released by shrinking the heap
+ *    since the last mem_reset_brk
+ */
+size_t mem_reclaimed()
+{
+    return mem_released;
+}
+
+/*
+ * mem_map - model of mmap for blocks kept outside the heap. Returns
+ *    size bytes of fresh, page-aligned, zeroed memory, or NULL.
+ */
+void *mem_map(size_t size)
+{
+    char *p;
+    int i;
+
+    /* the table grows by mapping rather than realloc, because memlib 
+       may be serving the process's own malloc (see mm_preload.c) */
+    if (mem_nmaps == mem_maxmaps) {
+	int n = mem_maxmaps ? 2 * mem_maxmaps : MAPS_CHUNK;
+	mem_region_t *maps;
+
+	if (mem_maps == NULL)
+	    maps = mmap(NULL, n * sizeof(mem_region_t), PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	else
+	    maps = mremap(mem_maps, mem_maxmaps * sizeof(mem_region_t),
+			  n * sizeof(mem_region_t), MREMAP_MAYMOVE);
+	if (maps == MAP_FAILED)
+	    return NULL;
+	mem_maps = maps;
+	mem_maxmaps = n;
+    }
+
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+	     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+	return NULL;
+
+    i = mem_map_slot(p);
+    memmove(&mem_maps[i + 1], &mem_maps[i],
+	    (mem_nmaps - i) * sizeof(mem_region_t));
+    mem_maps[i].addr = p;
+    mem_maps[i].size = size;
+    mem_nmaps++;
+    mem_mapped += size;
+    return p;
+}
+
+/*
+ * mem_unmap - release a mapping made by mem_map
+ */
+int mem_unmap(void *p, size_t size)
+{
+    mem_region_t *map = mem_find_map(p);
+
+    if (map == NULL || map->size != size) {
+	errno = EINVAL;
+	fprintf(stderr, "ERROR: mem_unmap failed. Not a mapping...\n");
+	return -1;
+    }
+
+    munmap(p, size);
+    mem_mapped -= size;
+    mem_nmaps--;
+    memmove(map, map + 1, (mem_maps + mem_nmaps - map) * sizeof(mem_region_t));
+    return 0;
+}
+
+/*
+ * mem_remap - resize a mapping made by mem_map, moving it if needed.
+ *    Returns the new address, or NULL with the old mapping intact.
+ */
+void *mem_remap(void *p, size_t old_size, size_t new_size)
+{
+    mem_region_t *map = mem_find_map(p);
+    char *q;
+    int i, j;
+
+    if (map == NULL || map->size != old_size) {
+	errno = EINVAL;
+	fprintf(stderr, "ERROR: mem_remap failed. Not a mapping...\n");
+	return NULL;
+    }
+
+    q = mremap(p, old_size, new_size, MREMAP_MAYMOVE);
+    if (q == MAP_FAILED)
+	return NULL;
+
+    /* a moved mapping takes its place in address order */
+    i = map - mem_maps;
+    j = mem_map_slot(q);
+    if (j > i) {
+	j--;
+	memmove(&mem_maps[i], &mem_maps[i + 1], (j - i) * sizeof(mem_region_t));
+    }
+    else if (j < i) {
+	memmove(&mem_maps[j + 1], &mem_maps[j], (i - j) * sizeof(mem_region_t));
+    }
+    mem_maps[j].addr = q;
+    mem_maps[j].size = new_size;
+    mem_mapped += new_size - old_size;
+    return q;
+}
+
+/*
+ * mem_is_mapped - returns 1 if [p, p+size) lies inside a single mapping
+ */
+int mem_is_mapped(void *p, size_t size)
+{
+    char *lo = (char *)p;
+    int i = mem_map_slot(lo) - 1;
+
+    return i >= 0 && lo + size <= mem_maps[i].addr + mem_maps[i].size;
+}
+
+/*
+ * mem_mapsize() - returns the bytes in live mappings
+ */
+size_t mem_mapsize()
+{
+    return mem_mapped;
+}
+
+/*
+ * mem_find_map - find the mapping that starts at p
+ */
+static mem_region_t *mem_find_map(void *p)
+{
+    int i = mem_map_slot(p) - 1;
+
+    if (i >= 0 && mem_maps[i].addr == (char *)p)
+	return &mem_maps[i];
+    return NULL;
+}
+
+/*
+ * mem_map_slot - binary search the mappings for the first one that
+ *    starts above p, returning its index (mem_nmaps if there is none)
+ */
+static int mem_map_slot(char *p)
+{
+    int lo = 0, hi = mem_nmaps, mid;
+
+    while (lo < hi) {
+	mid = (lo + hi) / 2;
+	if (mem_maps[mid].addr <= p)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo;
+}
@@ -2,10 +2,19 @@
 
 void mem_init(void);               
 void mem_deinit(void);
+void mem_set_max_heap(size_t size);
 void *mem_sbrk(int incr);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
+void *mem_fresh_lo(void);
 size_t mem_heapsize(void);
+size_t mem_max_heap(void);
 size_t mem_pagesize(void);
+size_t mem_reclaimed(void);
+void *mem_map(size_t size);
+int mem_unmap(void *p, size_t size);
+void *mem_remap(void *p, size_t old_size, size_t new_size);
+int mem_is_mapped(void *p, size_t size);
+size_t mem_mapsize(void);
 
@@ -0,0 +1,58 @@
+#include <stdio.h>
+
+extern int mm_init (void);
+extern void *mm_malloc (size_t size);
+extern void mm_free (void *ptr);
+extern void *mm_realloc(void *ptr, size_t size);
+extern int mm_trim(size_t pad);
+
+/* Aligned and zeroed allocation, like memalign, posix_memalign and calloc */
+extern void *mm_memalign(size_t alignment, size_t size);
+extern int mm_posix_memalign(void **memptr, size_t alignment, size_t size);
+extern void *mm_calloc(size_t nmemb, size_t size);
+
+/* Only the segregated package provides this so far (see mm_preload.c) */
+extern size_t mm_usable_size(void *ptr);
+
+/* Allocate n blocks of size bytes into out, returning how many were, and
+   free the n blocks in ptrs, which is left reordered. Only the segregated
+   and explicit packages provide these so far. */
+extern size_t mm_malloc_batch(size_t size, size_t n, void **out);
+extern void mm_free_batch(void **ptrs, size_t n);
+
+/* 
+ * A snapshot of the free blocks in the heap, taken by mm_heapstats.
+ * Sizes include the block headers and footers. Blocks held in fast bins
+ * are not counted as free until they are consolidated.
+ */
+#define MM_MAX_BINS 32
+typedef struct {
+    size_t free_blocks;   /* free blocks in the heap */
+    size_t free_bytes;    /* bytes in those blocks */
+    size_t largest_free;  /* size of the largest one */
+    int nbins;            /* size classes used below (0 if none) */
+    size_t bin_blocks[MM_MAX_BINS]; /* free blocks in each size class */
+    size_t fast_blocks;   /* blocks held in fast bins */
+    size_t fast_hits;     /* requests served from a fast bin */
+    size_t fast_misses;   /* fast-bin sized requests that found it empty */
+    size_t consolidations; /* times the fast bins were emptied */
+} mm_heapstats_t;
+
+extern int mm_heapstats(mm_heapstats_t *stats);
+
+
+/* 
+ * Students work in teams of one or two.  Teams enter their team name, 
+ * personal names and login IDs in a struct of this
+ * type in their bits.c file.
+ */
+typedef struct {
+    char *teamname; /* ID1+ID2 or ID1 */
+    char *name1;    /* full name of first member */
+    char *id1;      /* login ID of first member */
+    char *name2;    /* full name of second member (if any) */
+    char *id2;      /* login ID of second member */
+} team_t;
+
+extern team_t team;
+
@@ -12,6 +12,8 @@
 #include "mm.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -19,6 +21,42 @@
 
 #include "memlib.h"
 
+/*********************************************************
+ * Select build options
+ ********************************************************/
+// Store free-list links as 32-bit offsets from mem_heap_lo() with 4-byte
+// headers, which lowers the minimum block to 16 bytes on 64-bit builds.
+#ifndef COMPRESSED_LINKS
+#define COMPRESSED_LINKS 0
+#endif
+
+// Give requests of at least MMAP_THRESHOLD bytes a mapping of their own from
+// mem_map instead of carving them out of the heap (0 disables).
+#ifndef MMAP_THRESHOLD
+#define MMAP_THRESHOLD (256 * 1024)
+#endif
+
+// Keep freed blocks of up to FASTBIN_MAX bytes in LIFO bins of one size each,
+// still marked allocated, and coalesce them when the free list misses
+// (0 disables).
+#ifndef FASTBIN_MAX
+#define FASTBIN_MAX 64
+#endif
+
+// Also coalesce the fast bins, as glibc does, before serving a request of
+// FASTBIN_LARGE bytes or more, once freeing a block leaves a free block of
+// FASTBIN_CONSOLIDATE bytes or more, and once FASTBIN_LIMIT blocks wait in
+// them, so that parked blocks cannot keep their neighbours apart for long.
+#ifndef FASTBIN_LARGE
+#define FASTBIN_LARGE (1 << 10)
+#endif
+#ifndef FASTBIN_CONSOLIDATE
+#define FASTBIN_CONSOLIDATE (1 << 16)
+#endif
+#ifndef FASTBIN_LIMIT
+#define FASTBIN_LIMIT 256
+#endif
+
 /*********************************************************
  * NOTE TO STUDENTS: Before you do anything else, please
  * provide your team information in the following struct.
@@ -43,9 +81,15 @@ team_t team = {
 
 #define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
 
+#if COMPRESSED_LINKS
+#define WSIZE     4
+#else
 #define WSIZE     sizeof(void *)
+#endif
 #define DSIZE     (2 * WSIZE)
 #define CHUNKSIZE (1 << 12) /* Extend heap by this amount (bytes) */
+#define BATCH_MAX (1 << 30) /* Largest region carved by one batch pass */
+#define BATCH_SORT_MAX 64   /* Longest batch sorted by insertion */
 
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
 #define MIN(x, y) ((x) > (y) ? (y) : (x))
@@ -58,12 +102,18 @@ team_t team = {
 #define PUT(p, val) (*(unsigned int *)(p) = (val))
 
 /* Read the size and allocated fields from address p */
-#define GET_SIZE(p)  (GET(p) & ~0x7)
-#define GET_ALLOC(p) (GET(p) & 0x1)
+#define GET_SIZE(p)       (GET(p) & ~0x7)
+#define GET_ALLOC(p)      (GET(p) & 0x1)
+#define GET_PREV_ALLOC(p) (GET(p) & 0x2)
+#define GET_MAPPED(p)     (GET(p) & 0x4)
+
+/* Set or clear the previous-block-allocated bit of the header at p */
+#define SET_PREV_ALLOC(p) PUT(p, GET(p) | PREV_ALLOC_BLK)
+#define CLR_PREV_ALLOC(p) PUT(p, GET(p) & ~PREV_ALLOC_BLK)
 
 /* Given block bp bp, compute address of its header and footer */
 #define HDRP(bp) ((unsigned char *)(bp)-WSIZE)
-#define FTRP(bp) ((unsigned char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
+#define FTRP(bp) ((unsigned char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)  // free
 
 /* Given block bp bp, compute address of next and previous blocks */
 #define NEXT_BLKP(bp) \
@@ -71,23 +121,77 @@ team_t team = {
 #define PREV_BLKP(bp) \
     ((unsigned char *)(bp)-GET_SIZE(((unsigned char *)(bp)-DSIZE)))
 
+#if COMPRESSED_LINKS
+/* Free-list links are heap offsets; 0 stands for NULL */
+#define LINK_PTR(off) \
+    ((off) ? (unsigned char *)mem_heap_lo() + (off) : NULL)
+#define LINK_OFF(p)                                                     \
+    ((p) ? (unsigned int)((unsigned char *)(p) -                         \
+                          (unsigned char *)mem_heap_lo())                \
+         : 0)
+
+#define PRED(bp) LINK_PTR(GET(bp))
+#define SUCC(bp) LINK_PTR(GET((unsigned char *)(bp) + WSIZE))
+#define SET_PRED(bp, p) PUT(bp, LINK_OFF(p))
+#define SET_SUCC(bp, p) PUT((unsigned char *)(bp) + WSIZE, LINK_OFF(p))
+#else
 #define PRED(bp) (*(unsigned char **)(bp))
-#define SUCC(bp) (*(unsigned char **)((bp) + WSIZE))
-
-typedef enum { ZERO_BLK = 0, FREE_BLK = 0, ALLOC_BLK = 1 } block_status_t;
+#define SUCC(bp) (*(unsigned char **)((unsigned char *)(bp) + WSIZE))
+#define SET_PRED(bp, p) (PRED(bp) = (unsigned char *)(p))
+#define SET_SUCC(bp, p) (SUCC(bp) = (unsigned char *)(p))
+#endif
+
+#if FASTBIN_MAX
+/* One fast bin per block size from 2 * DSIZE up to FASTBIN_MAX */
+#define FASTBIN_COUNT (FASTBIN_MAX / DSIZE - 1)
+#define FASTBIN_INDEX(size) ((size) / DSIZE - 2)
+
+/* A block in a fast bin links to the next one in its payload */
+#define FASTBIN_NEXT(bp) (*(void **)(bp))
+#endif
+
+/* Only free blocks have a footer; headers record if the previous block is */
+typedef enum {
+    ZERO_BLK = 0,
+    FREE_BLK = 0,
+    ALLOC_BLK = 1,
+    PREV_ALLOC_BLK = 2,
+    MAPPED_BLK = 4
+} block_status_t;
 
 /* Declarations */
 static void place(void *bp, size_t asize);
 static void *find_fit(size_t asize);
 static void *extend_heap(size_t);
 static void *coalesce(void *);
+static void *free_block(void *bp);
+static int consolidate(void);
 static void *attach_free_list(void *bp);
 static void *detach_free_list(void *bp);
+static void *find_aligned_fit(size_t asize, size_t align);
+static void *place_aligned(void *bp, size_t asize, size_t align);
+static size_t aligned_lead(void *bp, size_t align);
+static void clear_fresh(void *bp, size_t bytes);
+static size_t carve_batch(void *bp, size_t asize, size_t n, void **out);
+static void sort_ptrs(void **ptrs, size_t n);
+static int ptr_cmp(const void *a, const void *b);
+#if MMAP_THRESHOLD
+static void *map_malloc(size_t size);
+static void map_free(void *bp);
+static void *map_realloc(void *bp, size_t size);
+static size_t map_len(size_t size);
+#endif
 
 /* Heap list */
 static void *heap_listp = NULL;
 static void *free_listp = NULL;
 
+#if FASTBIN_MAX
+/* Fast bins, and how they have served requests since mm_init */
+static void *fastbin[FASTBIN_COUNT];
+static size_t fast_blocks, fast_hits, fast_misses, consolidations;
+#endif
+
 /*
  * mm_init - initialize the malloc package.
  */
@@ -97,13 +201,20 @@ int mm_init(void) {
         return -1;
     }
 
-    PUT(heap_listp, 0);                                     // Alignment padding
-    PUT(heap_listp + (1 * WSIZE), PACK(DSIZE, ALLOC_BLK));  // Prologue header
-    PUT(heap_listp + (2 * WSIZE), PACK(DSIZE, ALLOC_BLK));  // Prologue footer
-    PUT(heap_listp + (3 * WSIZE), PACK(0, ALLOC_BLK));      // Epilogue header
+    PUT(heap_listp, 0);  // Alignment padding
+    PUT(heap_listp + (1 * WSIZE),
+        PACK(DSIZE, ALLOC_BLK | PREV_ALLOC_BLK));  // Prologue header
+    PUT(heap_listp + (2 * WSIZE),
+        PACK(DSIZE, ALLOC_BLK | PREV_ALLOC_BLK));  // Prologue footer
+    PUT(heap_listp + (3 * WSIZE),
+        PACK(0, ALLOC_BLK | PREV_ALLOC_BLK));  // Epilogue header
 
     heap_listp = heap_listp + (2 * WSIZE);
     free_listp = NULL;
+#if FASTBIN_MAX
+    memset(fastbin, 0, sizeof(fastbin));
+    fast_blocks = fast_hits = fast_misses = consolidations = 0;
+#endif
 
     // Extend the empty heap with a free block of CHUNKSIZE bytes
     if (extend_heap(CHUNKSIZE / WSIZE) == NULL) {
@@ -125,17 +236,43 @@ void *mm_malloc(size_t size) {
         return NULL;
     }
 
+#if MMAP_THRESHOLD
+    if (size >= MMAP_THRESHOLD) {
+        return map_malloc(size);
+    }
+#endif
+
     if (size <= DSIZE) {
         asize = 2 * DSIZE;
     } else {
-        asize = DSIZE * ((size + DSIZE + DSIZE - 1) / DSIZE);
+        asize = DSIZE * ((size + WSIZE + DSIZE - 1) / DSIZE);
     }
 
+#if FASTBIN_MAX
+    if (asize <= FASTBIN_MAX) {
+        if ((bp = fastbin[FASTBIN_INDEX(asize)]) != NULL) {
+            fastbin[FASTBIN_INDEX(asize)] = FASTBIN_NEXT(bp);
+            fast_blocks--;
+            fast_hits++;
+            return bp;
+        }
+        fast_misses++;
+    } else if (asize >= FASTBIN_LARGE) {
+        consolidate();
+    }
+#endif
+
     if ((bp = find_fit(asize)) != NULL) {
         place(bp, asize);
         return bp;
     }
 
+    // Coalesce the fast bins before growing the heap
+    if (consolidate() && (bp = find_fit(asize)) != NULL) {
+        place(bp, asize);
+        return bp;
+    }
+
     extend_size = MAX(asize, CHUNKSIZE);
     if ((bp = extend_heap(extend_size / WSIZE)) == NULL) {
         return NULL;
@@ -145,18 +282,80 @@ void *mm_malloc(size_t size) {
 }
 
 /*
- * mm_free - Freeing a block does nothing.
+ * mm_free - Put a small block in its fast bin as it is, and free any other
+ * block for real, emptying the fast bins if that leaves a large free block.
  */
 void mm_free(void *bp) {
+#if FASTBIN_MAX
     size_t size = GET_SIZE(HDRP(bp));
+#endif
 
-    PUT(HDRP(bp), PACK(size, FREE_BLK));
+#if MMAP_THRESHOLD
+    if (GET_MAPPED(HDRP(bp))) {
+        map_free(bp);
+        return;
+    }
+#endif
+
+#if FASTBIN_MAX
+    if (size <= FASTBIN_MAX) {
+        FASTBIN_NEXT(bp) = fastbin[FASTBIN_INDEX(size)];
+        fastbin[FASTBIN_INDEX(size)] = bp;
+        if (++fast_blocks > FASTBIN_LIMIT) {
+            consolidate();
+        }
+        return;
+    }
+    if (GET_SIZE(HDRP(free_block(bp))) >= FASTBIN_CONSOLIDATE) {
+        consolidate();
+    }
+#else
+    free_block(bp);
+#endif
+}
+
+/*
+ * free_block - Mark block bp free and coalesce it with its neighbours.
+ * Returns the coalesced block.
+ */
+static void *free_block(void *bp) {
+    size_t size = GET_SIZE(HDRP(bp));
+
+    PUT(HDRP(bp), PACK(size, FREE_BLK | GET_PREV_ALLOC(HDRP(bp))));
     PUT(FTRP(bp), PACK(size, FREE_BLK));
-    coalesce(bp);
+    CLR_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+    return coalesce(bp);
+}
+
+/*
+ * consolidate - Empty the fast bins, freeing their blocks for real. Returns
+ * the number of blocks freed.
+ */
+static int consolidate(void) {
+#if FASTBIN_MAX
+    int i, n = 0;
+    void *bp;
+
+    if (fast_blocks == 0) {
+        return 0;
+    }
+    for (i = 0; i < FASTBIN_COUNT; i++) {
+        while ((bp = fastbin[i]) != NULL) {
+            fastbin[i] = FASTBIN_NEXT(bp);
+            free_block(bp);
+            n++;
+        }
+    }
+    fast_blocks = 0;
+    consolidations++;
+    return n;
+#else
+    return 0;
+#endif
 }
 
 static void *coalesce(void *bp) {
-    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
     size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
     size_t size = GET_SIZE(HDRP(bp));
 
@@ -164,20 +363,22 @@ static void *coalesce(void *bp) {
     if (prev_alloc && !next_alloc) {
         detach_free_list(NEXT_BLKP(bp));
         size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
-        PUT(HDRP(bp), PACK(size, FREE_BLK));
+        PUT(HDRP(bp), PACK(size, FREE_BLK | PREV_ALLOC_BLK));
         PUT(FTRP(bp), PACK(size, FREE_BLK));
     } else if (!prev_alloc && next_alloc) {
         detach_free_list(PREV_BLKP(bp));
         size += GET_SIZE(HDRP(PREV_BLKP(bp)));
         PUT(FTRP(bp), PACK(size, FREE_BLK));
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size, FREE_BLK));
+        PUT(HDRP(PREV_BLKP(bp)),
+            PACK(size, FREE_BLK | GET_PREV_ALLOC(HDRP(PREV_BLKP(bp)))));
         bp = PREV_BLKP(bp);
     } else if (!prev_alloc && !next_alloc) {
         detach_free_list(PREV_BLKP(bp));
         detach_free_list(NEXT_BLKP(bp));
-        size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(FTRP(NEXT_BLKP(bp)));
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size, FREE_BLK));
+        size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(HDRP(NEXT_BLKP(bp)));
         PUT(FTRP(NEXT_BLKP(bp)), PACK(size, FREE_BLK));
+        PUT(HDRP(PREV_BLKP(bp)),
+            PACK(size, FREE_BLK | GET_PREV_ALLOC(HDRP(PREV_BLKP(bp)))));
         bp = PREV_BLKP(bp);
     }
 
@@ -193,7 +394,27 @@ void *mm_realloc(void *bp, size_t size) {
     void *old_ptr = bp;
     void *new_ptr;
     size_t old_size = GET_SIZE(HDRP(old_ptr));
-    size_t new_size = ALIGN(size+DSIZE);  // Add header, footer byte
+    size_t new_size;
+
+#if MMAP_THRESHOLD
+    if (GET_MAPPED(HDRP(bp))) {
+        return map_realloc(bp, size);
+    }
+
+    // Grown past the threshold: move the block into a mapping of its own
+    if (size >= MMAP_THRESHOLD) {
+        if ((new_ptr = map_malloc(size)) == NULL) return NULL;
+        memcpy(new_ptr, old_ptr, MIN(old_size - WSIZE, size));
+        mm_free(bp);
+        return new_ptr;
+    }
+#endif
+
+    if (size <= DSIZE) {
+        new_size = 2 * DSIZE;
+    } else {
+        new_size = DSIZE * ((size + WSIZE + DSIZE - 1) / DSIZE);
+    }
 
     if (new_size == old_size) {
         return old_ptr;
@@ -201,11 +422,13 @@ void *mm_realloc(void *bp, size_t size) {
 
     else if (new_size < old_size) {
         if ((old_size - new_size) >= (2 * DSIZE)) {
-            PUT(HDRP(old_ptr), PACK(new_size, ALLOC_BLK));
-            PUT(FTRP(old_ptr), PACK(new_size, ALLOC_BLK));
-            PUT(HDRP(NEXT_BLKP(old_ptr)), PACK(old_size - new_size, FREE_BLK));
+            PUT(HDRP(old_ptr),
+                PACK(new_size, ALLOC_BLK | GET_PREV_ALLOC(HDRP(old_ptr))));
+            PUT(HDRP(NEXT_BLKP(old_ptr)),
+                PACK(old_size - new_size, FREE_BLK | PREV_ALLOC_BLK));
             PUT(FTRP(NEXT_BLKP(old_ptr)), PACK(old_size - new_size, FREE_BLK));
-            attach_free_list(NEXT_BLKP(old_ptr));
+            CLR_PREV_ALLOC(HDRP(NEXT_BLKP(NEXT_BLKP(old_ptr))));
+            coalesce(NEXT_BLKP(old_ptr));
         }
         return old_ptr;
     }
@@ -215,55 +438,284 @@ void *mm_realloc(void *bp, size_t size) {
         detach_free_list(NEXT_BLKP(old_ptr));
 
         size_t extended_size = old_size + GET_SIZE(HDRP(NEXT_BLKP(old_ptr)));
+        size_t prev_alloc = GET_PREV_ALLOC(HDRP(old_ptr));
 
         if ((extended_size - new_size) >= (2 * DSIZE)) {
-            PUT(HDRP(old_ptr), PACK(new_size, ALLOC_BLK));
-            PUT(FTRP(old_ptr), PACK(new_size, ALLOC_BLK));
+            PUT(HDRP(old_ptr), PACK(new_size, ALLOC_BLK | prev_alloc));
             PUT(HDRP(NEXT_BLKP(old_ptr)),
-                PACK(extended_size - new_size, FREE_BLK));
+                PACK(extended_size - new_size, FREE_BLK | PREV_ALLOC_BLK));
             PUT(FTRP(NEXT_BLKP(old_ptr)),
                 PACK(extended_size - new_size, FREE_BLK));
             attach_free_list(NEXT_BLKP(old_ptr));
         } else {
-            PUT(HDRP(old_ptr), PACK(extended_size, ALLOC_BLK));
-            PUT(FTRP(old_ptr), PACK(extended_size, ALLOC_BLK));
+            PUT(HDRP(old_ptr), PACK(extended_size, ALLOC_BLK | prev_alloc));
+            SET_PREV_ALLOC(HDRP(NEXT_BLKP(old_ptr)));
         }
         return old_ptr;
     }
 
-    else if (!GET_ALLOC(HDRP(PREV_BLKP(old_ptr))) &&
+    else if (!GET_PREV_ALLOC(HDRP(old_ptr)) &&
             (old_size + GET_SIZE(HDRP(PREV_BLKP(old_ptr)))) >= new_size) {
         detach_free_list(PREV_BLKP(old_ptr));
 
         size_t extended_size = old_size + GET_SIZE(HDRP(PREV_BLKP(old_ptr)));
         old_ptr = PREV_BLKP(old_ptr);
 
+        // A free block always follows an allocated one
+        memmove(old_ptr, bp, old_size - WSIZE);
         if ((extended_size - new_size) >= (2 * DSIZE)) {
-            memmove(old_ptr, NEXT_BLKP(old_ptr), GET_SIZE(HDRP(NEXT_BLKP(old_ptr)))-(DSIZE));
-            PUT(HDRP(old_ptr), PACK(new_size, ALLOC_BLK));
-            PUT(FTRP(old_ptr), PACK(new_size, ALLOC_BLK));
+            PUT(HDRP(old_ptr), PACK(new_size, ALLOC_BLK | PREV_ALLOC_BLK));
             PUT(HDRP(NEXT_BLKP(old_ptr)),
-                PACK(extended_size - new_size, FREE_BLK));
+                PACK(extended_size - new_size, FREE_BLK | PREV_ALLOC_BLK));
             PUT(FTRP(NEXT_BLKP(old_ptr)),
                 PACK(extended_size - new_size, FREE_BLK));
+            CLR_PREV_ALLOC(HDRP(NEXT_BLKP(NEXT_BLKP(old_ptr))));
             attach_free_list(NEXT_BLKP(old_ptr));
         } else {
-            memmove(old_ptr, NEXT_BLKP(old_ptr), GET_SIZE(HDRP(NEXT_BLKP(old_ptr)))-(DSIZE));
-            PUT(HDRP(old_ptr), PACK(extended_size, ALLOC_BLK));
-            PUT(FTRP(old_ptr), PACK(extended_size, ALLOC_BLK));
+            PUT(HDRP(old_ptr), PACK(extended_size, ALLOC_BLK | PREV_ALLOC_BLK));
         }
         return old_ptr;
     }
 
     else {
-        new_ptr = mm_malloc(new_size);
+        new_ptr = mm_malloc(size);
         if (new_ptr == NULL) return NULL;
-        memcpy(new_ptr, old_ptr, old_size);
+        memcpy(new_ptr, old_ptr, old_size - WSIZE);
         mm_free(bp);
         return new_ptr;
     }
 }
 
+/*
+ * mm_memalign - Allocate a block whose payload is aligned to alignment bytes,
+ * a power of two. It is carved out of a free block, and the slack on either
+ * side goes back to the free list.
+ */
+void *mm_memalign(size_t alignment, size_t size) {
+    size_t asize;
+    void *bp;
+
+    if (alignment <= ALIGNMENT) {
+        return mm_malloc(size);
+    }
+    if (size == 0 || (alignment & (alignment - 1)) != 0) {
+        return NULL;
+    }
+
+    if (size <= DSIZE) {
+        asize = 2 * DSIZE;
+    } else {
+        asize = DSIZE * ((size + WSIZE + DSIZE - 1) / DSIZE);
+    }
+
+    if ((bp = find_aligned_fit(asize, alignment)) == NULL &&
+        (!consolidate() ||
+         (bp = find_aligned_fit(asize, alignment)) == NULL)) {
+        // Room for the block at any alignment, plus a leading free block
+        if ((bp = extend_heap((asize + alignment + 2 * DSIZE) / WSIZE)) ==
+            NULL) {
+            return NULL;
+        }
+    }
+    return place_aligned(bp, asize, alignment);
+}
+
+/*
+ * mm_posix_memalign - mm_memalign with the interface of posix_memalign.
+ */
+int mm_posix_memalign(void **memptr, size_t alignment, size_t size) {
+    void *bp;
+
+    if (alignment % sizeof(void *) != 0 ||
+        (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    if ((bp = mm_memalign(alignment, size)) == NULL && size != 0) {
+        return ENOMEM;
+    }
+    *memptr = bp;
+    return 0;
+}
+
+/*
+ * mm_calloc - Allocate a zeroed array of nmemb elements of size bytes.
+ */
+void *mm_calloc(size_t nmemb, size_t size) {
+    unsigned char *fresh = mem_fresh_lo();
+    size_t bytes;
+    void *bp;
+
+    if (size != 0 && nmemb > SIZE_MAX / size) {
+        return NULL;
+    }
+    bytes = nmemb * size;
+
+#if MMAP_THRESHOLD
+    // A new mapping is already zero
+    if (bytes >= MMAP_THRESHOLD) {
+        return map_malloc(bytes);
+    }
+#endif
+
+    if ((bp = mm_malloc(bytes)) == NULL) {
+        return NULL;
+    }
+
+    // A block carved from heap that mem_sbrk had never handed out is zero
+    // but for what the allocator wrote into it
+    if ((unsigned char *)bp >= fresh) {
+        clear_fresh(bp, bytes);
+    } else {
+        memset(bp, 0, bytes);
+    }
+    return bp;
+}
+
+/*
+ * mm_malloc_batch - Allocate n blocks of size bytes into out, carving as many
+ * as fit from each free block taken. Returns the blocks allocated, which is
+ * less than n only if the heap ran out.
+ */
+size_t mm_malloc_batch(size_t size, size_t n, void **out) {
+    size_t asize, need, done = 0;
+    void *bp;
+
+    if (size == 0) {
+        return 0;
+    }
+
+#if MMAP_THRESHOLD
+    if (size >= MMAP_THRESHOLD) {
+        while (done < n && (out[done] = map_malloc(size)) != NULL) {
+            done++;
+        }
+        return done;
+    }
+#endif
+
+    if (size <= DSIZE) {
+        asize = 2 * DSIZE;
+    } else {
+        asize = DSIZE * ((size + WSIZE + DSIZE - 1) / DSIZE);
+    }
+
+    while (done < n) {
+        // Carve as many blocks as fit from the block a single one would
+        // get, and when none fits, grow the heap by the rest of the batch
+        need = asize * MIN(n - done, MAX(BATCH_MAX / asize, 1));
+        if ((bp = find_fit(asize)) == NULL &&
+            (!consolidate() || (bp = find_fit(asize)) == NULL) &&
+            (bp = extend_heap(MAX(need, CHUNKSIZE) / WSIZE)) == NULL) {
+            break;
+        }
+        done += carve_batch(bp, asize, n - done, out + done);
+    }
+    return done;
+}
+
+/*
+ * mm_free_batch - Free the n blocks in ptrs. Mappings are freed as they come,
+ * and the heap blocks are sorted by address at the front of ptrs. Blocks that
+ * are neighbours in the heap are freed together as one block, so each run is
+ * coalesced and put on the free list only once.
+ */
+void mm_free_batch(void **ptrs, size_t n) {
+    unsigned char *bp;
+    size_t i, m, size;
+
+    for (i = m = 0; i < n; i++) {
+        if ((bp = ptrs[i]) == NULL) {
+            continue;
+        }
+#if MMAP_THRESHOLD
+        if (GET_MAPPED(HDRP(bp))) {
+            map_free(bp);
+            continue;
+        }
+#endif
+        ptrs[m++] = bp;
+    }
+
+    sort_ptrs(ptrs, m);
+    for (i = 0; i < m; i++) {
+        bp = ptrs[i];
+        size = GET_SIZE(HDRP(bp));
+        while (i + 1 < m && (unsigned char *)ptrs[i + 1] == bp + size) {
+            size += GET_SIZE(HDRP(ptrs[++i]));
+        }
+        PUT(HDRP(bp), PACK(size, ALLOC_BLK | GET_PREV_ALLOC(HDRP(bp))));
+        free_block(bp);
+    }
+}
+
+/*
+ * mm_trim - Give the free block at the end of the heap back to memlib,
+ * keeping pad bytes of it. Returns 1 if the heap shrank.
+ */
+int mm_trim(size_t pad) {
+    unsigned char *epilogue;
+    size_t size, keep;
+    void *bp;
+
+    // A fast block at the end of the heap would hold it up
+    consolidate();
+    epilogue = (unsigned char *)mem_heap_hi() + 1 - WSIZE;
+
+    // The block before the epilogue must be free
+    if (GET_PREV_ALLOC(epilogue)) {
+        return 0;
+    }
+    size = GET_SIZE(epilogue - WSIZE);
+    bp = epilogue - size + WSIZE;
+
+    // What stays behind must still be a valid free block
+    keep = DSIZE * ((pad + (DSIZE - 1)) / DSIZE);
+    if (keep != 0 && keep < 2 * DSIZE) {
+        keep = 2 * DSIZE;
+    }
+    if (keep >= size) {
+        return 0;
+    }
+
+    detach_free_list(bp);
+    if (keep == 0) {
+        PUT(HDRP(bp), PACK(0, ALLOC_BLK | GET_PREV_ALLOC(HDRP(bp))));
+    } else {
+        PUT(HDRP(bp), PACK(keep, FREE_BLK | GET_PREV_ALLOC(HDRP(bp))));
+        PUT(FTRP(bp), PACK(keep, FREE_BLK));
+        PUT(HDRP(NEXT_BLKP(bp)), PACK(0, ALLOC_BLK));  // New epilogue header
+        attach_free_list(bp);
+    }
+    mem_sbrk(-(int)(size - keep));
+    return 1;
+}
+
+/*
+ * mm_heapstats - Count the free blocks by walking the heap. The single
+ * free list has no size classes, and blocks in the fast bins look allocated.
+ */
+int mm_heapstats(mm_heapstats_t *stats) {
+    size_t size;
+
+    memset(stats, 0, sizeof(*stats));
+#if FASTBIN_MAX
+    stats->fast_blocks = fast_blocks;
+    stats->fast_hits = fast_hits;
+    stats->fast_misses = fast_misses;
+    stats->consolidations = consolidations;
+#endif
+    for (void *bp = heap_listp; (size = GET_SIZE(HDRP(bp))) != 0;
+         bp = NEXT_BLKP(bp)) {
+        if (GET_ALLOC(HDRP(bp))) {
+            continue;
+        }
+        stats->free_blocks++;
+        stats->free_bytes += size;
+        stats->largest_free = MAX(stats->largest_free, size);
+    }
+    return 0;
+}
+
 /*
  * extend_heap - Extend the heap by allocating a new free block.
  */
@@ -277,8 +729,9 @@ static void *extend_heap(size_t words) {
         return NULL;
     }
 
-    // Initialize free block header/footer and the epilogue header
-    PUT(HDRP(bp), PACK(size, FREE_BLK));           // Free block header
+    // Initialize free block header/footer and the epilogue header. The new
+    // block takes over the old epilogue's previous-allocated bit.
+    PUT(HDRP(bp), PACK(size, FREE_BLK | GET_PREV_ALLOC(HDRP(bp))));
     PUT(FTRP(bp), PACK(size, FREE_BLK));           // Free block footer
     PUT(HDRP(NEXT_BLKP(bp)), PACK(0, ALLOC_BLK));  // New epilogue header
 
@@ -303,22 +756,21 @@ static void place(void *bp, size_t asize) {
 
     detach_free_list(bp);
     if ((csize - asize) >= (2 * DSIZE)) {
-        PUT(HDRP(bp), PACK(asize, ALLOC_BLK));
-        PUT(FTRP(bp), PACK(asize, ALLOC_BLK));
+        PUT(HDRP(bp), PACK(asize, ALLOC_BLK | GET_PREV_ALLOC(HDRP(bp))));
         bp = NEXT_BLKP(bp);
-        PUT(HDRP(bp), PACK(csize - asize, FREE_BLK));
+        PUT(HDRP(bp), PACK(csize - asize, FREE_BLK | PREV_ALLOC_BLK));
         PUT(FTRP(bp), PACK(csize - asize, FREE_BLK));
         attach_free_list(bp);
     } else {
-        PUT(HDRP(bp), PACK(csize, ALLOC_BLK));
-        PUT(FTRP(bp), PACK(csize, ALLOC_BLK));
+        PUT(HDRP(bp), PACK(csize, ALLOC_BLK | GET_PREV_ALLOC(HDRP(bp))));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
     }
 }
 
 static void *attach_free_list(void *bp) {
-    SUCC(bp) = free_listp;
+    SET_SUCC(bp, free_listp);
     if (free_listp != NULL) {
-        PRED(free_listp) = bp;
+        SET_PRED(free_listp, bp);
     }
 
     free_listp = bp;
@@ -332,18 +784,219 @@ static void *detach_free_list(void *bp) {
             return bp;
         }
         free_listp = SUCC(bp);
-        SUCC(bp) = NULL;
+        SET_SUCC(bp, NULL);
 
         return bp;
     }
 
     if (SUCC(bp) != NULL) {
-        PRED(SUCC(bp)) = PRED(bp);
+        SET_PRED(SUCC(bp), PRED(bp));
     }
 
     if (PRED(bp) != NULL) {
-        SUCC(PRED(bp)) = SUCC(bp);
+        SET_SUCC(PRED(bp), SUCC(bp));
+    }
+
+    return bp;
+}
+
+/*
+ * find_aligned_fit - Find a free block that can hold an aligned block of
+ * asize bytes after skipping its aligned_lead bytes.
+ */
+static void *find_aligned_fit(size_t asize, size_t align) {
+    void *bp;
+
+    for (bp = free_listp; bp != NULL; bp = SUCC(bp)) {
+        if (GET_SIZE(HDRP(bp)) >= aligned_lead(bp, align) + asize) {
+            return bp;
+        }
     }
 
+    return NULL;
+}
+
+/*
+ * place_aligned - Allocate the aligned part of free block bp, returning the
+ * leading and trailing slack to the free list.
+ */
+static void *place_aligned(void *bp, size_t asize, size_t align) {
+    size_t csize = GET_SIZE(HDRP(bp));
+    size_t lead = aligned_lead(bp, align);
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+
+    detach_free_list(bp);
+
+    if (lead != 0) {
+        PUT(HDRP(bp), PACK(lead, FREE_BLK | prev_alloc));
+        PUT(FTRP(bp), PACK(lead, FREE_BLK));
+        attach_free_list(bp);
+        bp = NEXT_BLKP(bp);
+        csize -= lead;
+        prev_alloc = 0;
+    }
+
+    if ((csize - asize) >= (2 * DSIZE)) {
+        PUT(HDRP(bp), PACK(asize, ALLOC_BLK | prev_alloc));
+        PUT(HDRP(NEXT_BLKP(bp)),
+            PACK(csize - asize, FREE_BLK | PREV_ALLOC_BLK));
+        PUT(FTRP(NEXT_BLKP(bp)), PACK(csize - asize, FREE_BLK));
+        attach_free_list(NEXT_BLKP(bp));
+    } else {
+        PUT(HDRP(bp), PACK(csize, ALLOC_BLK | prev_alloc));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+    }
     return bp;
-}
\ No newline at end of file
+}
+
+/*
+ * aligned_lead - Bytes to skip from the start of free block bp so that the
+ * payload is aligned and the skipped bytes can stand as a free block.
+ */
+static size_t aligned_lead(void *bp, size_t align) {
+    size_t lead = (align - ((uintptr_t)bp & (align - 1))) & (align - 1);
+
+    while (lead != 0 && lead < 2 * DSIZE) {
+        lead += align;
+    }
+    return lead;
+}
+
+/*
+ * clear_fresh - Zero the first bytes of block bp, which was carved from
+ * fresh heap. Only its free list links and, if the block was not split,
+ * the footer it had as a free block can be nonzero.
+ */
+static void clear_fresh(void *bp, size_t bytes) {
+    size_t footer = GET_SIZE(HDRP(bp)) - DSIZE;
+
+    memset(bp, 0, MIN(bytes, DSIZE));
+    if (bytes > footer) {
+        memset((unsigned char *)bp + footer, 0, bytes - footer);
+    }
+}
+
+/*
+ * carve_batch - Split up to n blocks of asize bytes off the front of free
+ * block bp into out, leaving the rest on the free list. Returns the blocks
+ * carved.
+ */
+static size_t carve_batch(void *bp, size_t asize, size_t n, void **out) {
+    size_t csize = GET_SIZE(HDRP(bp));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+    size_t bsize, done = 0;
+
+    detach_free_list(bp);
+    while (done < n && csize >= asize) {
+        // A tail too small to be a free block goes with the last block
+        bsize = (csize - asize >= 2 * DSIZE) ? asize : csize;
+        PUT(HDRP(bp), PACK(bsize, ALLOC_BLK | prev_alloc));
+        prev_alloc = PREV_ALLOC_BLK;
+        out[done++] = bp;
+        csize -= bsize;
+        bp = NEXT_BLKP(bp);
+    }
+
+    if (csize > 0) {
+        PUT(HDRP(bp), PACK(csize, FREE_BLK | PREV_ALLOC_BLK));
+        PUT(FTRP(bp), PACK(csize, FREE_BLK));
+        attach_free_list(bp);
+    } else {
+        SET_PREV_ALLOC(HDRP(bp));
+    }
+    return done;
+}
+
+/*
+ * sort_ptrs - Sort n block pointers by address. Batches mostly come in the
+ * order they were allocated or the reverse, which an insertion sort handles
+ * in linear time once a descending array is turned around.
+ */
+static void sort_ptrs(void **ptrs, size_t n) {
+    size_t i, j;
+    void *p;
+
+    if (n > BATCH_SORT_MAX) {
+        qsort(ptrs, n, sizeof(void *), ptr_cmp);
+        return;
+    }
+
+    if (n > 1 && (uintptr_t)ptrs[0] > (uintptr_t)ptrs[n - 1]) {
+        for (i = 0, j = n - 1; i < j; i++, j--) {
+            p = ptrs[i];
+            ptrs[i] = ptrs[j];
+            ptrs[j] = p;
+        }
+    }
+    for (i = 1; i < n; i++) {
+        p = ptrs[i];
+        for (j = i; j > 0 && (uintptr_t)ptrs[j - 1] > (uintptr_t)p; j--) {
+            ptrs[j] = ptrs[j - 1];
+        }
+        ptrs[j] = p;
+    }
+}
+
+/*
+ * ptr_cmp - Order two block pointers by address, for qsort.
+ */
+static int ptr_cmp(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t)*(void *const *)a;
+    uintptr_t y = (uintptr_t)*(void *const *)b;
+
+    return (x > y) - (x < y);
+}
+
+#if MMAP_THRESHOLD
+/*
+ * map_malloc - Serve a request from a mapping of its own. The payload starts
+ * DSIZE bytes in, behind a header holding the mapping length.
+ */
+static void *map_malloc(size_t size) {
+    size_t len = map_len(size);
+    unsigned char *map;
+
+    if (len == 0 || (map = mem_map(len)) == NULL) {
+        return NULL;
+    }
+    PUT(map + DSIZE - WSIZE, PACK(len, ALLOC_BLK | MAPPED_BLK));
+    return map + DSIZE;
+}
+
+/*
+ * map_free - Give the mapping of block bp back to memlib.
+ */
+static void map_free(void *bp) {
+    mem_unmap((unsigned char *)bp - DSIZE, GET_SIZE(HDRP(bp)));
+}
+
+/*
+ * map_realloc - Resize the mapping of block bp, which may move it.
+ */
+static void *map_realloc(void *bp, size_t size) {
+    size_t old_len = GET_SIZE(HDRP(bp));
+    size_t len = map_len(size);
+    unsigned char *map;
+
+    if (len == old_len) {
+        return bp;
+    }
+    if (len == 0 ||
+        (map = mem_remap((unsigned char *)bp - DSIZE, old_len, len)) == NULL) {
+        return NULL;
+    }
+    PUT(map + DSIZE - WSIZE, PACK(len, ALLOC_BLK | MAPPED_BLK));
+    return map + DSIZE;
+}
+
+/*
+ * map_len - Length of the mapping for a request of size bytes, or 0 if the
+ * header can't record it.
+ */
+static size_t map_len(size_t size) {
+    size_t pagesize = mem_pagesize();
+    size_t len = (size + DSIZE + pagesize - 1) & ~(pagesize - 1);
+
+    return len > 0xFFFFFFF8 ? 0 : len;
+}
+#endif
@@ -14,6 +14,8 @@
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdint.h>
+#include <errno.h>
 
 #include "mm.h"
 #include "memlib.h"
@@ -42,6 +44,12 @@ team_t team = {
 #define NEXTFIT
 // #define BESTFIT
 
+// Requests of MMAP_THRESHOLD bytes or more get a mapping of their own from
+// mem_map rather than a block of the heap (0 disables)
+#ifndef MMAP_THRESHOLD
+#define MMAP_THRESHOLD (256 * 1024)
+#endif
+
 // Basic constants and macros
 #define WSIZE       4       // Word and header / footer size (bytes)
 #define DSIZE       8       // Double word size (bytes)
@@ -59,20 +67,35 @@ team_t team = {
 // Read the size and allocated fields from address p
 #define GET_SIZE(p) (GET(p) & ~0x7) // get 0xXXXXXXX_
 #define GET_ALLOC(p) (GET(p) & 0x1) // 0 is free, 1 is allocated
+#define GET_PREV_ALLOC(p) (GET(p) & 0x2) // 0 if the previous block is free
+#define GET_MAPPED(p) (GET(p) & 0x4) // 1 if the block has a mapping of its own
+
+// Set or clear the previous-block-allocated bit of the header at p
+#define SET_PREV_ALLOC(p) PUT(p, GET(p) | 0x2)
+#define CLR_PREV_ALLOC(p) PUT(p, GET(p) & ~0x2)
 
 // Given block ptr block_pt, compute address of its header and footer
 #define HDRP(block_pt) ((char *)(block_pt) - WSIZE) // header pointer = block_pt - header size(wsize)
-#define FTRP(block_pt) ((char *)(block_pt) + GET_SIZE(HDRP(block_pt)) - DSIZE)    // footer pointer = block_pt + block_pt size - dsize
+#define FTRP(block_pt) ((char *)(block_pt) + GET_SIZE(HDRP(block_pt)) - DSIZE)    // footer pointer = block_pt + block_pt size - dsize (free blocks only)
 
 // Given block ptr block_pt, compute address of next and previous blocks
 #define NEXT_BLKP(block_pt) ((char *)(block_pt) + GET_SIZE((char *)(block_pt) - WSIZE))   // next block pointer = block_pt + size of block_pt - wsize
-#define PREV_BLKP(block_pt) ((char *)(block_pt) - GET_SIZE((char *)(block_pt) - DSIZE))   // previous block pointer = (block_pt - wsize) - previous block size(information in footer) + wsize 
+#define PREV_BLKP(block_pt) ((char *)(block_pt) - GET_SIZE((char *)(block_pt) - DSIZE))   // previous block pointer = (block_pt - wsize) - previous block size(information in footer) + wsize, previous block must be free
 
 /* Private local function Declaration */
 static void *coalesce(void *);
 static void *extend_heap(size_t);
 static void *find_fit(size_t);
 static void place(void *, size_t);
+static void *find_aligned_fit(size_t, size_t);
+static void *place_aligned(void *, size_t, size_t);
+static size_t aligned_lead(void *, size_t);
+#if MMAP_THRESHOLD
+static void *map_malloc(size_t);
+static void map_free(void *);
+static void *map_realloc(void *, size_t);
+static size_t map_len(size_t);
+#endif
 
 /* Private local variable Declaration*/
 static char *heap_pt;
@@ -83,7 +106,7 @@ static char *last_block_pt;
  * coalesce - Free block coalescing for efficient memory management.
  */
 static void *coalesce(void *block_pt) {
-    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(block_pt)));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(block_pt));
     size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(block_pt)));
     size_t size = GET_SIZE(HDRP(block_pt));
 
@@ -98,22 +121,22 @@ static void *coalesce(void *block_pt) {
 
     else if (prev_alloc && !next_alloc) {   // case 2
         size += GET_SIZE(HDRP(NEXT_BLKP(block_pt)));
-        PUT(HDRP(block_pt), PACK(size, 0));
+        PUT(HDRP(block_pt), PACK(size, 0x2));
         PUT(FTRP(block_pt), PACK(size, 0));
     }
 
     else if (!prev_alloc && next_alloc) {   // case 3
         size += GET_SIZE(HDRP(PREV_BLKP(block_pt)));
         PUT(FTRP(block_pt), PACK(size, 0));
-        PUT(HDRP(PREV_BLKP(block_pt)), PACK(size, 0));
+        PUT(HDRP(PREV_BLKP(block_pt)), PACK(size, GET_PREV_ALLOC(HDRP(PREV_BLKP(block_pt)))));
         block_pt = PREV_BLKP(block_pt);
     }
 
     else {                                  // case 4
         size += GET_SIZE(HDRP(PREV_BLKP(block_pt))) +
-        GET_SIZE(FTRP(NEXT_BLKP(block_pt)));
-        PUT(HDRP(PREV_BLKP(block_pt)), PACK(size, 0));
+        GET_SIZE(HDRP(NEXT_BLKP(block_pt)));
         PUT(FTRP(NEXT_BLKP(block_pt)), PACK(size, 0));
+        PUT(HDRP(PREV_BLKP(block_pt)), PACK(size, GET_PREV_ALLOC(HDRP(PREV_BLKP(block_pt)))));
         block_pt = PREV_BLKP(block_pt);
     }
 
@@ -137,7 +160,7 @@ static void *extend_heap(size_t words) {
         return NULL;
 
     // Initialize free block header/footer and the epilogue header
-    PUT(HDRP(block_pt), PACK(size, 0));           // Free block header
+    PUT(HDRP(block_pt), PACK(size, GET_PREV_ALLOC(HDRP(block_pt))));  // Free block header, keeps the old epilogue's prev bit
     PUT(FTRP(block_pt), PACK(size, 0));           // Free block footer
     PUT(HDRP(NEXT_BLKP(block_pt)), PACK(0, 1));   // New epilogue header
 
@@ -215,16 +238,64 @@ static void place(void * block_pt, size_t asize) {
     size_t csize = GET_SIZE(HDRP(block_pt));
 
     if ((csize - asize) >= (2*DSIZE)) {
-        PUT(HDRP(block_pt), PACK(asize, 1));
-        PUT(FTRP(block_pt), PACK(asize, 1));
+        PUT(HDRP(block_pt), PACK(asize, GET_PREV_ALLOC(HDRP(block_pt)) | 1));
         block_pt = NEXT_BLKP(block_pt);
-        PUT(HDRP(block_pt), PACK(csize-asize, 0));
+        PUT(HDRP(block_pt), PACK(csize-asize, 0x2));
         PUT(FTRP(block_pt), PACK(csize-asize, 0));
     }
     else {
-        PUT(HDRP(block_pt), PACK(csize, 1));
-        PUT(FTRP(block_pt), PACK(csize, 1));
+        PUT(HDRP(block_pt), PACK(csize, GET_PREV_ALLOC(HDRP(block_pt)) | 1));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(block_pt)));
+    }
+}
+
+/*
+ * find_aligned_fit - Find the first free block that can hold an aligned
+ *     block of asize bytes after skipping its aligned_lead bytes.
+ */
+static void *find_aligned_fit(size_t asize, size_t align)
+{
+    char *block_pt;
+
+    for (block_pt = heap_pt; GET_SIZE(HDRP(block_pt)) > 0; block_pt = NEXT_BLKP(block_pt)) {
+        if (!GET_ALLOC(HDRP(block_pt)) &&
+            aligned_lead(block_pt, align) + asize <= GET_SIZE(HDRP(block_pt)))
+            return block_pt;
     }
+    return NULL;
+}
+
+/*
+ * place_aligned - Allocate the aligned part of free block block_pt, leaving
+ *     the leading and trailing slack as free blocks.
+ */
+static void *place_aligned(void *block_pt, size_t asize, size_t align)
+{
+    size_t csize = GET_SIZE(HDRP(block_pt));
+    size_t lead = aligned_lead(block_pt, align);
+
+    if (lead != 0) {
+        PUT(HDRP(block_pt), PACK(lead, GET_PREV_ALLOC(HDRP(block_pt))));
+        PUT(FTRP(block_pt), PACK(lead, 0));
+        block_pt = NEXT_BLKP(block_pt);
+        PUT(HDRP(block_pt), PACK(csize - lead, 0));
+        PUT(FTRP(block_pt), PACK(csize - lead, 0));
+    }
+    place(block_pt, asize);
+    return block_pt;
+}
+
+/*
+ * aligned_lead - Bytes to skip from the start of free block block_pt so that
+ *     the payload is aligned and the skipped bytes can stand as a free block.
+ */
+static size_t aligned_lead(void *block_pt, size_t align)
+{
+    size_t lead = (align - ((uintptr_t)block_pt & (align - 1))) & (align - 1);
+
+    while (lead != 0 && lead < 2*DSIZE)
+        lead += align;
+    return lead;
 }
 
 /* 
@@ -237,9 +308,9 @@ int mm_init(void)
         return -1;
     
     PUT(heap_pt, 0);                            // Alignment padding
-    PUT(heap_pt + (1*WSIZE), PACK(DSIZE, 1));   // Prologue header
-    PUT(heap_pt + (2*WSIZE), PACK(DSIZE, 1));   // Prologue footer
-    PUT(heap_pt + (3*WSIZE), PACK(0, 1));       // Epilogue header
+    PUT(heap_pt + (1*WSIZE), PACK(DSIZE, 0x3)); // Prologue header
+    PUT(heap_pt + (2*WSIZE), PACK(DSIZE, 0x3)); // Prologue footer
+    PUT(heap_pt + (3*WSIZE), PACK(0, 0x3));     // Epilogue header
     
     heap_pt += (2*WSIZE);
 
@@ -268,11 +339,16 @@ void *mm_malloc(size_t size)
     if (size == 0) 
         return NULL;
 
+#if MMAP_THRESHOLD
+    if (size >= MMAP_THRESHOLD)
+        return map_malloc(size);
+#endif
+
     // Adjust block size to include overhead and alignment reqs
     if (size <= DSIZE)
         asize = 2*DSIZE;
     else
-        asize = DSIZE * ((size + (DSIZE) + (DSIZE-1)) / DSIZE);
+        asize = DSIZE * ((size + (WSIZE) + (DSIZE-1)) / DSIZE);
 
     // Search the free list for a fit
     if ((block_pt = find_fit(asize)) != NULL) {
@@ -305,8 +381,16 @@ void mm_free(void *ptr)
 {
     size_t size = GET_SIZE(HDRP(ptr));
 
-    PUT(HDRP(ptr), PACK(size, 0));
+#if MMAP_THRESHOLD
+    if (GET_MAPPED(HDRP(ptr))) {
+        map_free(ptr);
+        return;
+    }
+#endif
+
+    PUT(HDRP(ptr), PACK(size, GET_PREV_ALLOC(HDRP(ptr))));
     PUT(FTRP(ptr), PACK(size, 0));
+    CLR_PREV_ALLOC(HDRP(NEXT_BLKP(ptr)));
     coalesce(ptr);
 }
 
@@ -318,19 +402,222 @@ void *mm_realloc(void *ptr, size_t size)
     void *old_ptr = ptr;
     void *new_ptr;
     size_t old_size = GET_SIZE(HDRP(old_ptr));
-    size_t new_size = size + (2*WSIZE);    // Add header, footer byte
+    size_t new_size = size + WSIZE;    // Add header byte
+
+#if MMAP_THRESHOLD
+    if (GET_MAPPED(HDRP(ptr)))
+        return map_realloc(ptr, size);
+#endif
       
     if (new_size <= old_size) {
         return old_ptr;
     }
 
     else {
-        new_ptr = mm_malloc(new_size);
+        new_ptr = mm_malloc(size);
         if (new_ptr == NULL) 
             return NULL;
     }
 
-    memcpy(new_ptr, old_ptr, new_size);
+    memcpy(new_ptr, old_ptr, old_size - WSIZE);
     mm_free(ptr);
     return new_ptr;
-}
\ No newline at end of file
+}
+
+/*
+ * mm_memalign - Allocate a block whose payload is aligned to alignment bytes,
+ *     a power of two. The slack on either side of it stays free.
+ */
+void *mm_memalign(size_t alignment, size_t size)
+{
+    size_t asize;
+    char *block_pt;
+
+    if (alignment <= DSIZE)
+        return mm_malloc(size);
+    if (size == 0 || (alignment & (alignment - 1)) != 0)
+        return NULL;
+
+    if (size <= DSIZE)
+        asize = 2*DSIZE;
+    else
+        asize = DSIZE * ((size + (WSIZE) + (DSIZE-1)) / DSIZE);
+
+    // Room for the block at any alignment, plus a leading free block
+    if ((block_pt = find_aligned_fit(asize, alignment)) == NULL &&
+        (block_pt = extend_heap((asize + alignment + 2*DSIZE)/WSIZE)) == NULL)
+        return NULL;
+    block_pt = place_aligned(block_pt, asize, alignment);
+
+    #ifdef NEXTFIT
+    last_block_pt = block_pt;
+    #endif
+
+    return block_pt;
+}
+
+/*
+ * mm_posix_memalign - mm_memalign with the interface of posix_memalign.
+ */
+int mm_posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    void *ptr;
+
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+    if ((ptr = mm_memalign(alignment, size)) == NULL && size != 0)
+        return ENOMEM;
+    *memptr = ptr;
+    return 0;
+}
+
+/*
+ * mm_calloc - Allocate a zeroed array of nmemb elements of size bytes.
+ */
+void *mm_calloc(size_t nmemb, size_t size)
+{
+    char *fresh = mem_fresh_lo();
+    size_t bytes, footer;
+    char *block_pt;
+
+    if (size != 0 && nmemb > SIZE_MAX / size)
+        return NULL;
+    bytes = nmemb * size;
+
+#if MMAP_THRESHOLD
+    // A new mapping is already zero
+    if (bytes >= MMAP_THRESHOLD)
+        return map_malloc(bytes);
+#endif
+
+    if ((block_pt = mm_malloc(bytes)) == NULL)
+        return NULL;
+
+    // Heap that mem_sbrk had never handed out is zero, and free blocks
+    // carry nothing but a footer
+    if (block_pt >= fresh) {
+        footer = GET_SIZE(HDRP(block_pt)) - DSIZE;
+        if (bytes > footer)
+            memset(block_pt + footer, 0, bytes - footer);
+    }
+    else
+        memset(block_pt, 0, bytes);
+    return block_pt;
+}
+
+/*
+ * mm_trim - Give the free block at the end of the heap back to memlib,
+ * keeping pad bytes of it. Returns 1 if the heap shrank.
+ */
+int mm_trim(size_t pad)
+{
+    char *epilogue = (char *)mem_heap_hi() + 1 - WSIZE;
+    char *block_pt;
+    size_t size, keep;
+
+    // The block before the epilogue must be free
+    if (GET_PREV_ALLOC(epilogue))
+        return 0;
+    size = GET_SIZE(epilogue - WSIZE);
+    block_pt = epilogue - size + WSIZE;
+
+    // What stays behind must still be a valid free block
+    keep = DSIZE * ((pad + (DSIZE - 1)) / DSIZE);
+    if (keep != 0 && keep < 2 * DSIZE)
+        keep = 2 * DSIZE;
+    if (keep >= size)
+        return 0;
+
+    if (keep == 0) {
+        PUT(HDRP(block_pt), PACK(0, 0x1 | GET_PREV_ALLOC(HDRP(block_pt))));
+    }
+    else {
+        PUT(HDRP(block_pt), PACK(keep, GET_PREV_ALLOC(HDRP(block_pt))));
+        PUT(FTRP(block_pt), PACK(keep, 0));
+        PUT(HDRP(NEXT_BLKP(block_pt)), PACK(0, 0x1));   // New epilogue header
+    }
+
+    #ifdef NEXTFIT
+    last_block_pt = heap_pt;
+    #endif
+
+    mem_sbrk(-(int)(size - keep));
+    return 1;
+}
+
+/*
+ * mm_heapstats - Count the free blocks by walking the heap. There are no
+ * size classes.
+ */
+int mm_heapstats(mm_heapstats_t *stats)
+{
+    char *block_pt;
+    size_t size;
+
+    memset(stats, 0, sizeof(*stats));
+    for (block_pt = heap_pt; (size = GET_SIZE(HDRP(block_pt))) != 0;
+         block_pt = NEXT_BLKP(block_pt)) {
+        if (GET_ALLOC(HDRP(block_pt)))
+            continue;
+        stats->free_blocks++;
+        stats->free_bytes += size;
+        if (size > stats->largest_free)
+            stats->largest_free = size;
+    }
+    return 0;
+}
+
+#if MMAP_THRESHOLD
+/*
+ * map_malloc - Serve a request from a mapping of its own, with the payload
+ *     DSIZE bytes in, behind a header holding the length of the mapping.
+ */
+static void *map_malloc(size_t size)
+{
+    size_t len = map_len(size);
+    char *map;
+
+    if (len == 0 || (map = mem_map(len)) == NULL)
+        return NULL;
+    PUT(map + DSIZE - WSIZE, PACK(len, 0x5));
+    return map + DSIZE;
+}
+
+/*
+ * map_free - Give the mapping of block ptr back to memlib.
+ */
+static void map_free(void *ptr)
+{
+    mem_unmap((char *)ptr - DSIZE, GET_SIZE(HDRP(ptr)));
+}
+
+/*
+ * map_realloc - Resize the mapping of block ptr, which may move it.
+ */
+static void *map_realloc(void *ptr, size_t size)
+{
+    size_t old_len = GET_SIZE(HDRP(ptr));
+    size_t len = map_len(size);
+    char *map;
+
+    if (len == old_len)
+        return ptr;
+    if (len == 0 ||
+        (map = mem_remap((char *)ptr - DSIZE, old_len, len)) == NULL)
+        return NULL;
+    PUT(map + DSIZE - WSIZE, PACK(len, 0x5));
+    return map + DSIZE;
+}
+
+/*
+ * map_len - Length of the mapping for a request of size bytes, or 0 if a
+ *     header can't hold it.
+ */
+static size_t map_len(size_t size)
+{
+    size_t pagesize = mem_pagesize();
+    size_t len = (size + DSIZE + pagesize - 1) & ~(pagesize - 1);
+
+    return len > 0xFFFFFFF8 ? 0 : len;
+}
+#endif
@@ -0,0 +1,252 @@
+/*
+ * mm_preload.c - Puts the segregated malloc package behind the libc
+ *     allocation functions, so that "make libmm.so" gives a library
+ *     that replaces the malloc of any program started with
+ *     LD_PRELOAD=./libmm.so.
+ *
+ * The package is built with THREAD_CACHE=1, and memlib's heap is a
+ * reservation of real address space (MM_HEAP_MB megabytes of it, 16 GB
+ * by default on 64-bit hosts) whose pages are committed as the heap
+ * grows. Only the functions below are exported; the package and
+ * memlib stay hidden inside the library.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define EXPORT __attribute__((visibility("default")))
+
+/* Every pointer handed out is aligned like glibc's, to two words */
+#define PRELOAD_ALIGN (2 * sizeof(void *))
+#define PRELOAD_SIZE(size) \
+    (((size) + PRELOAD_ALIGN - 1) & ~(PRELOAD_ALIGN - 1))
+
+/* Address space reserved for the heap unless MM_HEAP_MB says otherwise */
+#define PRELOAD_HEAP ((size_t)1 << (sizeof(void *) == 8 ? 34 : 30))
+
+/* Requests made while the package is being set up (by the pthread
+   calls mm_init makes, for one) are served from here and never freed */
+#define BOOT_HEAP (64 * 1024)
+
+/* The size of boot block p, kept in the PRELOAD_ALIGN bytes before it */
+#define BOOT_SIZE(p) (((size_t *)(p))[-1])
+
+static pthread_once_t preload_once = PTHREAD_ONCE_INIT;
+static int preload_ready;           /* mm_init has succeeded */
+static __thread int preload_busy;   /* this thread is running preload_init */
+static char boot_heap[BOOT_HEAP] __attribute__((aligned(16)));
+static size_t boot_brk;
+
+/*
+ * preload_init - Reserve the heap and initialize the package, once
+ */
+static void preload_init(void)
+{
+    char *mb = getenv("MM_HEAP_MB");
+    size_t size = PRELOAD_HEAP;
+
+    if (mb != NULL && atol(mb) > 0)
+	size = (size_t)atol(mb) << 20;
+
+    preload_busy = 1;
+    mem_set_max_heap(size);
+    mem_init();
+    if (mm_init() == 0)
+	__atomic_store_n(&preload_ready, 1, __ATOMIC_RELEASE);
+    preload_busy = 0;
+}
+
+/*
+ * preload_start - Return nonzero once the package can serve requests
+ */
+static inline int preload_start(void)
+{
+    if (__atomic_load_n(&preload_ready, __ATOMIC_ACQUIRE))
+	return 1;
+    if (preload_busy)
+	return 0;
+    pthread_once(&preload_once, preload_init);
+    return preload_ready;
+}
+
+/*
+ * boot_malloc - Carve a block out of boot_heap, behind a header that
+ *     records its size
+ */
+static void *boot_malloc(size_t size)
+{
+    size_t bytes, old;
+    char *p;
+
+    if (size > BOOT_HEAP)
+	return NULL;
+    size = size ? PRELOAD_SIZE(size) : PRELOAD_ALIGN;
+    bytes = PRELOAD_ALIGN + size;
+    old = __atomic_fetch_add(&boot_brk, bytes, __ATOMIC_RELAXED);
+    if (old + bytes > BOOT_HEAP)
+	return NULL;
+    p = boot_heap + old + PRELOAD_ALIGN;
+    BOOT_SIZE(p) = size;
+    return p;
+}
+
+static inline int is_boot(void *ptr)
+{
+    return (char *)ptr >= boot_heap && (char *)ptr < boot_heap + BOOT_HEAP;
+}
+
+/*
+ * preload_memalign - Allocate size bytes aligned to alignment, a power of
+ *     two, setting errno on failure
+ */
+static void *preload_memalign(size_t alignment, size_t size)
+{
+    void *p;
+
+    if (!preload_start()) {
+	if (alignment > PRELOAD_ALIGN)
+	    return NULL;
+	return boot_malloc(size);
+    }
+    if (size > SIZE_MAX - 2 * PRELOAD_ALIGN) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    size = size ? PRELOAD_SIZE(size) : PRELOAD_ALIGN;
+    if (alignment <= PRELOAD_ALIGN)
+	p = mm_malloc(size);
+    else
+	p = mm_memalign(alignment, size);
+    if (p == NULL)
+	errno = ENOMEM;
+    return p;
+}
+
+EXPORT void *malloc(size_t size)
+{
+    return preload_memalign(PRELOAD_ALIGN, size);
+}
+
+EXPORT void free(void *ptr)
+{
+    if (ptr == NULL || is_boot(ptr))
+	return;
+    mm_free(ptr);
+}
+
+EXPORT size_t malloc_usable_size(void *ptr)
+{
+    if (ptr == NULL)
+	return 0;
+    if (is_boot(ptr))
+	return BOOT_SIZE(ptr);
+    return mm_usable_size(ptr);
+}
+
+EXPORT void *realloc(void *ptr, size_t size)
+{
+    void *p;
+
+    if (ptr == NULL)
+	return malloc(size);
+    if (size == 0) {
+	free(ptr);
+	return NULL;
+    }
+
+    /* A boot block is never resized in place */
+    if (is_boot(ptr)) {
+	size_t old = BOOT_SIZE(ptr);
+
+	if ((p = malloc(size)) != NULL)
+	    memcpy(p, ptr, old < size ? old : size);
+	return p;
+    }
+
+    if (size > SIZE_MAX - 2 * PRELOAD_ALIGN) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    if ((p = mm_realloc(ptr, PRELOAD_SIZE(size))) == NULL)
+	errno = ENOMEM;
+    return p;
+}
+
+EXPORT void *calloc(size_t nmemb, size_t size)
+{
+    size_t bytes;
+    void *p;
+
+    if (__builtin_mul_overflow(nmemb, size, &bytes)) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    if (bytes == 0 || !preload_start()) {
+	if ((p = malloc(bytes)) != NULL)
+	    memset(p, 0, bytes);
+	return p;
+    }
+    if (bytes > SIZE_MAX - 2 * PRELOAD_ALIGN) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    if ((p = mm_calloc(1, PRELOAD_SIZE(bytes))) == NULL)
+	errno = ENOMEM;
+    return p;
+}
+
+EXPORT void *reallocarray(void *ptr, size_t nmemb, size_t size)
+{
+    size_t bytes;
+
+    if (__builtin_mul_overflow(nmemb, size, &bytes)) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    return realloc(ptr, bytes);
+}
+
+EXPORT void *memalign(size_t alignment, size_t size)
+{
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+	errno = EINVAL;
+	return NULL;
+    }
+    return preload_memalign(alignment, size);
+}
+
+EXPORT void *aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+EXPORT int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    void *p;
+
+    if (alignment % sizeof(void *) != 0 ||
+	(alignment & (alignment - 1)) != 0)
+	return EINVAL;
+    if ((p = preload_memalign(alignment, size)) == NULL)
+	return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+EXPORT void *valloc(size_t size)
+{
+    return preload_memalign(sysconf(_SC_PAGESIZE), size);
+}
+
+EXPORT void *pvalloc(size_t size)
+{
+    size_t pagesize = sysconf(_SC_PAGESIZE);
+
+    return preload_memalign(pagesize, (size + pagesize - 1) & ~(pagesize - 1));
+}
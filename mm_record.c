@@ -0,0 +1,329 @@
+/*
+ * mm_record.c - Records the allocation requests of a running program,
+ *     so that they can be replayed by mdriver. "make librecord.so"
+ *     builds it, and
+ *
+ *         unix> MM_RECORD=app.rec LD_PRELOAD=./librecord.so app
+ *
+ *     logs every malloc, calloc, memalign (and the other aligned
+ *     allocators), free and realloc that app makes to app.rec.<pid>,
+ *     with glibc still serving the requests. traces/rec2rep.pl turns the
+ *     log into a balanced trace.
+ *
+ * The log is a sequence of rec_t records in host byte order. Every
+ * thread fills a buffer of its own and appends it to the log with a
+ * single write when it is full, when the thread exits and when the
+ * process exits, so records of different threads interleave in the
+ * file. A global sequence number, taken before a block is released
+ * and after one is obtained, puts them back in order: an address is
+ * never handed out again before the request that released it. A
+ * realloc takes one of each, since it may do both.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define EXPORT __attribute__((visibility("default")))
+
+/* glibc's allocator under its internal names, which unlike dlsym
+   never allocate */
+extern void *__libc_malloc(size_t size);
+extern void __libc_free(void *ptr);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+/* Request types, numbered like mdriver's traceop_t */
+#define REC_ALLOC   0
+#define REC_FREE    1
+#define REC_REALLOC 2
+#define REC_CALLOC  3
+#define REC_MEMALIGN 4
+
+/* One logged request */
+typedef struct {
+    uint64_t seq;    /* position in the global order */
+    uint64_t seq0;   /* for a realloc, when the old block was released */
+    uint64_t type;   /* REC_ALLOC, REC_FREE, ... */
+    uint64_t ptr;    /* block returned, or freed */
+    uint64_t old;    /* block passed to realloc, or memalign's alignment */
+    uint64_t size;   /* bytes asked for */
+} rec_t;
+
+#define REC_BUF_LEN 8192  /* records per thread buffer, 384 KB */
+
+/* A thread's buffer. Buffers are never unmapped: a thread that exits
+   leaves its buffer to the next thread that starts. */
+typedef struct recbuf {
+    struct recbuf *next;   /* all buffers, for flushing at exit */
+    int in_use;            /* owned by a live thread */
+    int len;               /* records held */
+    rec_t recs[REC_BUF_LEN];
+} recbuf_t;
+
+static int rec_fd = -1;                 /* the log, or -1 if not recording */
+static char rec_base[256];              /* log name without the .<pid> */
+static uint64_t rec_seq;                /* next sequence number */
+static pthread_once_t rec_once = PTHREAD_ONCE_INIT;
+static pthread_key_t rec_key;           /* runs rec_release at thread exit */
+static pthread_mutex_t rec_lock = PTHREAD_MUTEX_INITIALIZER; /* rec_bufs */
+static recbuf_t *rec_bufs;
+static __thread recbuf_t *rec_buf;      /* this thread's buffer */
+static __thread int rec_busy;           /* this thread is in rec_init */
+static __thread int rec_exited;         /* this thread released its buffer */
+
+static void rec_init(void);
+static void rec_open(void);
+static void rec_flush(recbuf_t *buf);
+static void rec_release(void *arg);
+static void rec_fork_child(void);
+static recbuf_t *rec_get(void);
+
+/*
+ * rec_init - Open the log and hook thread exit and fork, once
+ */
+static void rec_init(void)
+{
+    char *name = getenv("MM_RECORD");
+
+    /* the pthread calls may allocate, and those requests go unrecorded */
+    rec_busy = 1;
+    snprintf(rec_base, sizeof(rec_base), "%s", name ? name : "mm.rec");
+    pthread_key_create(&rec_key, rec_release);
+    pthread_atfork(NULL, NULL, rec_fork_child);
+    rec_open();
+    rec_busy = 0;
+}
+
+/*
+ * rec_open - Start the log of this process, <base>.<pid>
+ */
+static void rec_open(void)
+{
+    char path[sizeof(rec_base) + 16];
+
+    snprintf(path, sizeof(path), "%s.%d", rec_base, (int)getpid());
+    rec_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC,
+		  0644);
+}
+
+/*
+ * rec_flush - Append the records in buf to the log and empty it
+ */
+static void rec_flush(recbuf_t *buf)
+{
+    char *p = (char *)buf->recs;
+    size_t left = buf->len * sizeof(rec_t);
+    ssize_t n;
+
+    while (left > 0 && rec_fd >= 0) {
+	if ((n = write(rec_fd, p, left)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    break;
+	}
+	p += n;
+	left -= n;
+    }
+    buf->len = 0;
+}
+
+/*
+ * rec_release - Flush an exiting thread's buffer and free it for reuse.
+ *     Requests the thread makes later on its way out go unrecorded, as
+ *     another thread may already own the buffer.
+ */
+static void rec_release(void *arg)
+{
+    recbuf_t *buf = arg;
+
+    rec_flush(buf);
+    rec_buf = NULL;
+    rec_exited = 1;
+    __atomic_store_n(&buf->in_use, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * rec_fork_child - A forked child drops the records it inherited, which
+ *     its parent logs, and starts a log of its own, numbered from 0
+ */
+static void rec_fork_child(void)
+{
+    recbuf_t *buf;
+
+    rec_seq = 0;
+
+    for (buf = rec_bufs; buf != NULL; buf = buf->next) {
+	buf->len = 0;
+	if (buf != rec_buf)
+	    buf->in_use = 0;
+    }
+    pthread_mutex_init(&rec_lock, NULL);
+    if (rec_fd >= 0)
+	close(rec_fd);
+    rec_open();
+}
+
+/*
+ * rec_get - Return this thread's buffer, claiming one on first use, or
+ *     NULL if there is no log
+ */
+static recbuf_t *rec_get(void)
+{
+    recbuf_t *buf;
+
+    if (rec_buf != NULL)
+	return rec_buf;
+    if (rec_busy || rec_exited)
+	return NULL;
+
+    pthread_once(&rec_once, rec_init);
+    if (rec_fd < 0)
+	return NULL;
+
+    pthread_mutex_lock(&rec_lock);
+    for (buf = rec_bufs; buf != NULL; buf = buf->next) {
+	if (!__atomic_load_n(&buf->in_use, __ATOMIC_ACQUIRE))
+	    break;
+    }
+    if (buf == NULL) {
+	buf = mmap(NULL, sizeof(recbuf_t), PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED) {
+	    pthread_mutex_unlock(&rec_lock);
+	    return NULL;
+	}
+	buf->next = rec_bufs;
+	rec_bufs = buf;
+    }
+    buf->in_use = 1;
+    buf->len = 0;
+    pthread_mutex_unlock(&rec_lock);
+
+    rec_buf = buf;
+    pthread_setspecific(rec_key, buf);
+    return buf;
+}
+
+/*
+ * rec_seq_next - Take the next sequence number
+ */
+static inline uint64_t rec_seq_next(void)
+{
+    return __atomic_fetch_add(&rec_seq, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * rec_log - Append a request to this thread's buffer
+ */
+static inline void rec_log(uint64_t seq, uint64_t seq0, int type, void *ptr,
+			   void *old, size_t size)
+{
+    recbuf_t *buf = rec_get();
+    rec_t *r;
+
+    if (buf == NULL)
+	return;
+    r = &buf->recs[buf->len++];
+    r->seq = seq;
+    r->seq0 = seq0;
+    r->type = type;
+    r->ptr = (uintptr_t)ptr;
+    r->old = (uintptr_t)old;
+    r->size = size;
+    if (buf->len == REC_BUF_LEN)
+	rec_flush(buf);
+}
+
+/*
+ * rec_exit - Flush every buffer when the process exits
+ */
+__attribute__((destructor)) static void rec_exit(void)
+{
+    recbuf_t *buf;
+
+    pthread_mutex_lock(&rec_lock);
+    for (buf = rec_bufs; buf != NULL; buf = buf->next)
+	rec_flush(buf);
+    pthread_mutex_unlock(&rec_lock);
+}
+
+EXPORT void *malloc(size_t size)
+{
+    void *p = __libc_malloc(size);
+
+    if (p != NULL)
+	rec_log(rec_seq_next(), 0, REC_ALLOC, p, NULL, size);
+    return p;
+}
+
+EXPORT void free(void *ptr)
+{
+    if (ptr != NULL)
+	rec_log(rec_seq_next(), 0, REC_FREE, ptr, NULL, 0);
+    __libc_free(ptr);
+}
+
+EXPORT void *realloc(void *ptr, size_t size)
+{
+    uint64_t seq0 = ptr ? rec_seq_next() : 0;
+    void *p = __libc_realloc(ptr, size);
+
+    if (ptr == NULL) {
+	if (p != NULL)
+	    rec_log(rec_seq_next(), 0, REC_ALLOC, p, NULL, size);
+    }
+    else if (size == 0 && p == NULL)
+	rec_log(seq0, 0, REC_FREE, ptr, NULL, 0);
+    else if (p != NULL)
+	rec_log(rec_seq_next(), seq0, REC_REALLOC, p, ptr, size);
+    return p;
+}
+
+EXPORT void *calloc(size_t nmemb, size_t size)
+{
+    void *p = __libc_calloc(nmemb, size);
+
+    if (p != NULL)
+	rec_log(rec_seq_next(), 0, REC_CALLOC, p, NULL, nmemb * size);
+    return p;
+}
+
+EXPORT void *memalign(size_t alignment, size_t size)
+{
+    void *p = __libc_memalign(alignment, size);
+
+    if (p != NULL)
+	rec_log(rec_seq_next(), 0, REC_MEMALIGN, p, (void *)alignment, size);
+    return p;
+}
+
+EXPORT void *aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+EXPORT int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    void *p;
+
+    if (alignment % sizeof(void *) != 0 ||
+	(alignment & (alignment - 1)) != 0)
+	return EINVAL;
+    if ((p = memalign(alignment, size)) == NULL)
+	return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+EXPORT void *valloc(size_t size)
+{
+    return memalign(sysconf(_SC_PAGESIZE), size);
+}
@@ -10,6 +10,8 @@
  * comment that gives a high level description of your solution.
  */
 #include <assert.h>
+#include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -18,6 +20,63 @@
 #include "memlib.h"
 #include "mm.h"
 
+/*********************************************************
+ * Select build options
+ ********************************************************/
+// Per-thread caches of small blocks in front of the shared free lists, with
+// a mutex around every other heap access. Build with -DTHREAD_CACHE=1
+// -pthread to use the allocator from several threads.
+#ifndef THREAD_CACHE
+#define THREAD_CACHE 0
+#endif
+
+// Requests of at most SLAB_THRESHOLD bytes are served from page-sized slabs
+// of equal slots that carry no header or footer. Must be a multiple of
+// ALIGNMENT; 0 sends every request through the segregated lists. Slab pages
+// are shared and only reached under the heap lock, so the thread-cache build
+// leaves small requests to the thread caches instead.
+#ifndef SLAB_THRESHOLD
+#if THREAD_CACHE
+#define SLAB_THRESHOLD 0
+#else
+#define SLAB_THRESHOLD 64
+#endif
+#endif
+
+// Store free-list links as 32-bit offsets from mem_heap_lo() with 4-byte
+// headers, which lowers the minimum block to 16 bytes on 64-bit builds.
+#ifndef COMPRESSED_LINKS
+#define COMPRESSED_LINKS 0
+#endif
+
+// Once freeing leaves a free block of at least TRIM_THRESHOLD bytes at the end
+// of the heap, give all but TRIM_PAD bytes of it back to memlib. 0 leaves
+// trimming to explicit mm_trim calls.
+#ifndef TRIM_THRESHOLD
+#define TRIM_THRESHOLD (256 * 1024)
+#endif
+
+// Requests of at least MMAP_THRESHOLD bytes get a mapping of their own from
+// mem_map, so freeing them never leaves a huge hole in the heap. 0 serves
+// every request from the heap.
+#ifndef MMAP_THRESHOLD
+#define MMAP_THRESHOLD (256 * 1024)
+#endif
+
+// Freed heap blocks of up to FASTBIN_MAX bytes wait in LIFO bins of one size
+// each, still marked allocated, and are coalesced only when a request misses
+// the free lists. 0 coalesces every block as it is freed.
+#ifndef FASTBIN_MAX
+#define FASTBIN_MAX 96
+#endif
+
+#if THREAD_CACHE
+#include <pthread.h>
+#endif
+#if SLAB_THRESHOLD
+#include <sys/mman.h>
+#endif
+
 /*********************************************************
  * NOTE TO STUDENTS: Before you do anything else, please
  * provide your team information in the following struct.
@@ -42,12 +101,22 @@ team_t team = {
 
 #define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
 
+#if COMPRESSED_LINKS
+#define WSIZE        4              // Word and header / footer size (bytes)
+#else
 #define WSIZE        sizeof(void *) // Word and header / footer size (bytes)
+#endif
 #define DSIZE        (2 * WSIZE)    // Double word size (bytes)
 #define CHUNKSIZE    (1 << 12)      /* Extend heap by this amount (bytes) */
+#define TRIM_PAD     (128 * 1024)   // Free tail left in place by auto trimming
+#define BATCH_MAX    (1 << 30)      // Largest region carved by one batch pass
+#define BATCH_SORT_MAX 64           // Longest batch sorted by insertion
+#define MAX_REQUEST  (0xFFFFFFF8 - 2 * DSIZE) // Most a block size can cover
 #define SEG_LIST_LEN 20
+#define TREE_INDEX   13             // Bins from here up (>= 4 KiB) form a tree
 
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
+#define MIN(x, y) ((x) > (y) ? (y) : (x))
 
 /* Pack a size and allocated bit into a word */
 #define PACK(size, alloc) ((size) | (alloc))
@@ -57,13 +126,32 @@ team_t team = {
 #define PUT(p, val) (*(unsigned int *)(p) = (val))
 
 /* Read the size and allocated fields from address p */
-#define GET_SIZE(p)  (GET(p) & ~0x7)        // get 0xXXXXX___
-#define GET_ALLOC(p) (GET(p) & 0x1)         // 0 is free, 1 is allocated
+#define GET_SIZE(p)       (GET(p) & ~0x7)   // get 0xXXXXX___
+#define GET_ALLOC(p)      (GET(p) & 0x1)    // 0 is free, 1 is allocated
+#define GET_PREV_ALLOC(p) (GET(p) & 0x2)    // 0 if the previous block is free
+
+/* Set or clear the previous-block-allocated bit of the header at p */
+#if THREAD_CACHE
+// The owner of an allocated block reads its header without the heap lock
+// while neighbours flip this bit under it, so both sides use atomics
+#define SET_PREV_ALLOC(p) \
+    __atomic_fetch_or((unsigned int *)(p), PREV_ALLOC_BLK, __ATOMIC_RELAXED)
+#define CLR_PREV_ALLOC(p) \
+    __atomic_fetch_and((unsigned int *)(p), ~PREV_ALLOC_BLK, __ATOMIC_RELAXED)
+#define GET_OWN(p) __atomic_load_n((unsigned int *)(p), __ATOMIC_RELAXED)
+#else
+#define SET_PREV_ALLOC(p) PUT(p, GET(p) | PREV_ALLOC_BLK)
+#define CLR_PREV_ALLOC(p) PUT(p, GET(p) & ~PREV_ALLOC_BLK)
+#define GET_OWN(p)        GET(p)
+#endif
+
+// Nonzero if the header at p belongs to a block with its own mapping
+#define GET_MAPPED(p) (GET(p) & 0x4)
 
 /* Given block bp bp, compute address of its header and footer */
 // header pointer = block_pt - header size(wsize)
 #define HDRP(bp) ((unsigned char *)(bp)-WSIZE)
-// footer pointer = block_pt + block_pt size - dsize
+// footer pointer = block_pt + block_pt size - dsize (free blocks only)
 #define FTRP(bp) ((unsigned char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)   
 
 /* Given block bp bp, compute address of next and previous blocks */
@@ -71,15 +159,103 @@ team_t team = {
 #define NEXT_BLKP(bp) \
     ((unsigned char *)(bp) + GET_SIZE(((unsigned char *)(bp)-WSIZE)))
 // previous block pointer = block_pt - previous block size(information in footer)
+// only valid when GET_PREV_ALLOC says the previous block is free
 #define PREV_BLKP(bp) \
     ((unsigned char *)(bp)-GET_SIZE(((unsigned char *)(bp)-DSIZE)))
 
+#if COMPRESSED_LINKS
+/* Free-list links are heap offsets; 0 stands for NULL */
+#define LINK_PTR(off) \
+    ((off) ? (unsigned char *)mem_heap_lo() + (off) : NULL)
+#define LINK_OFF(p)                                                     \
+    ((p) ? (unsigned int)((unsigned char *)(p) -                         \
+                          (unsigned char *)mem_heap_lo())                \
+         : 0)
+
+#define PRED(bp) LINK_PTR(GET(bp))
+#define SUCC(bp) LINK_PTR(GET((unsigned char *)(bp) + WSIZE))
+#define SET_PRED(bp, p) PUT(bp, LINK_OFF(p))
+#define SET_SUCC(bp, p) PUT((unsigned char *)(bp) + WSIZE, LINK_OFF(p))
+#else
 #define PRED(bp) (*(unsigned char **)(bp))
-#define SUCC(bp) (*(unsigned char **)((bp) + WSIZE))
+#define SUCC(bp) (*(unsigned char **)((unsigned char *)(bp) + WSIZE))
+#define SET_PRED(bp, p) (PRED(bp) = (unsigned char *)(p))
+#define SET_SUCC(bp, p) (SUCC(bp) = (unsigned char *)(p))
+#endif
+
+/* AVL links of a large free block, ordered by (size, address) */
+#define TREE_LEFT(bp)   (((void **)(bp))[0])
+#define TREE_RIGHT(bp)  (((void **)(bp))[1])
+#define TREE_HEIGHT(bp) (*(int *)((void **)(bp) + 2))
+
+#if FASTBIN_MAX
+#define FASTBIN_COUNT (FASTBIN_MAX / DSIZE - 1)  // One bin per block size
+#define FASTBIN_INDEX(asize) ((asize) / DSIZE - 2)
+#define FASTBIN_NEXT(bp)     (*(void **)(bp))    // Chained through the payload
+#endif
+
+#if THREAD_CACHE
+#define TCACHE_MAX_SIZE (32 * DSIZE)  // Largest block size kept per thread
+#define TCACHE_CLASSES  (TCACHE_MAX_SIZE / DSIZE - 1)
+#define TCACHE_DEPTH    32  // Max blocks cached per class and thread
+#define TCACHE_BATCH    16  // Blocks moved per refill / flush
+
+// Cached blocks stay marked allocated and are chained through their payload
+#define TCACHE_INDEX(asize) ((asize) / DSIZE - 2)
+#define TCACHE_NEXT(bp)     (*(void **)(bp))
+
+#define LOCK_HEAP()   pthread_mutex_lock(&heap_lock)
+#define UNLOCK_HEAP() pthread_mutex_unlock(&heap_lock)
+#else
+#define LOCK_HEAP()
+#define UNLOCK_HEAP()
+#endif
+
+#if SLAB_THRESHOLD
+#define SLAB_PAGE_SHIFT 12
+#define SLAB_PAGE_SIZE  (1 << SLAB_PAGE_SHIFT)  // Bytes per slab page
+#define SLAB_CLASSES    (SLAB_THRESHOLD / ALIGNMENT)
+#define SLAB_WORD_BITS  (8 * sizeof(unsigned long))
+#define SLAB_BITMAP_LEN (SLAB_PAGE_SIZE / ALIGNMENT / SLAB_WORD_BITS)
+
+// Size class of a request and the slot size of a class
+#define SLAB_INDEX(size)      (((size) - 1) / ALIGNMENT)
+#define SLAB_SLOT_SIZE(index) (((index) + 1) * ALIGNMENT)
+
+// Slots follow the page header, which is padded to a double word so that
+// slots of an even size are double word aligned like heap payloads; the
+// tail of the page that can't hold a whole slot is unused
+#define SLAB_HDR_SIZE ((sizeof(slab_page_t) + DSIZE - 1) & ~(DSIZE - 1))
+#define SLAB_SLOTS(index) \
+    ((SLAB_PAGE_SIZE - SLAB_HDR_SIZE) / SLAB_SLOT_SIZE(index))
+
+// Index of the page holding p in slab_map
+#define SLAB_MAP_INDEX(p)                        \
+    (((uintptr_t)(p) >> SLAB_PAGE_SHIFT) -       \
+     ((uintptr_t)mem_heap_lo() >> SLAB_PAGE_SHIFT))
+#endif
 
-typedef enum { ZERO_BLK = 0, FREE_BLK = 0, ALLOC_BLK = 1 } block_status_t;
+/*
+ * Only free blocks carry a footer. Every header records whether the block
+ * before it is allocated, which is all coalesce needs from an allocated
+ * neighbour.
+ */
+typedef enum {
+    ZERO_BLK = 0,
+    FREE_BLK = 0,
+    ALLOC_BLK = 1,
+    PREV_ALLOC_BLK = 2,
+    MAPPED_BLK = 4
+} block_status_t;
 
 /* Declarations */
+static size_t adjust_size(size_t size);
+static void *malloc_block(size_t asize);
+static void free_block(void *bp);
+static void release_block(void *bp);
+static int consolidate(void);
+static void *realloc_block(void *bp, size_t size);
+static int trim_heap(size_t pad);
 static void place(void *bp, size_t asize);
 static void *find_fit(size_t asize);
 static void *extend_heap(size_t);
@@ -87,31 +263,137 @@ static void *coalesce(void *);
 static void *attach_free_list(void *bp, size_t asize);
 static void *detach_free_list(void *bp);
 static size_t asize_to_index(size_t asize);
+static void *tree_find_fit(size_t asize);
+static void *tree_insert(void *node, void *bp);
+static void *tree_remove(void *node, void *bp);
+static void *tree_remove_min(void *node, void **min);
+static void *tree_balance(void *node);
+static void *tree_rotate_left(void *node);
+static void *tree_rotate_right(void *node);
+static int tree_height(void *node);
+static int tree_less(void *a, void *b);
+static void *malloc_aligned_block(size_t asize, size_t align);
+static void *find_aligned_fit(size_t asize, size_t align);
+static void *place_aligned(void *bp, size_t asize, size_t align);
+static size_t aligned_lead(void *bp, size_t align);
+static void clear_fresh(void *bp, size_t bytes);
+static size_t malloc_batch_blocks(size_t asize, size_t n, void **out);
+static size_t carve_batch(void *bp, size_t asize, size_t n, void **out);
+static void sort_ptrs(void **ptrs, size_t n);
+static int ptr_cmp(const void *a, const void *b);
 
 /* Heap list */
 static void *heap_listp = NULL;
-static void *free_listp[SEG_LIST_LEN] = {NULL};
+static void *free_listp[TREE_INDEX] = {NULL};
+static void *free_treep = NULL;  // Root of the large block tree
+
+#if FASTBIN_MAX
+/* Fast bins, and how they have served requests since mm_init */
+static void *fastbin[FASTBIN_COUNT];
+static size_t fast_blocks, fast_hits, fast_misses, consolidations;
+#endif
+
+#if SLAB_THRESHOLD
+/* Header at the start of every slab page */
+typedef struct slab_page {
+    struct slab_page *prev;               // Neighbours on the partial list
+    struct slab_page *next;
+    unsigned int index;                   // Size class of the slots
+    unsigned int nfree;                   // Slots not handed out
+    unsigned long used[SLAB_BITMAP_LEN];  // One bit per slot, 1 is in use
+} slab_page_t;
+
+static void *slab_malloc(size_t size);
+static void slab_free(slab_page_t *page, void *bp);
+static void *slab_realloc(slab_page_t *page, void *bp, size_t size);
+static slab_page_t *slab_page_new(size_t index);
+static slab_page_t *slab_page_of(void *bp);
+static int slab_map_init(void);
+static void slab_link(slab_page_t *page);
+static void slab_unlink(slab_page_t *page);
+
+static slab_page_t *slab_partial[SLAB_CLASSES];  // Pages with a free slot
+static unsigned int slab_pages[SLAB_CLASSES];    // Pages owned by each class
+static unsigned char *slab_map;   // Nonzero for slab pages, one per heap page
+static size_t slab_map_len;       // Entries mapped
+static size_t slab_map_used;      // Entries past the last one ever set
+#endif
+
+#if MMAP_THRESHOLD
+static void *map_malloc(size_t size);
+static void map_free(void *bp);
+static void *map_realloc(void *bp, size_t size);
+static size_t map_len(size_t size);
+#endif
+
+#if THREAD_CACHE
+/* Per-thread stacks of recently freed small blocks */
+typedef struct {
+    unsigned long epoch;                 // heap_epoch the blocks belong to
+    void *head[TCACHE_CLASSES];          // Top of each class stack
+    unsigned int count[TCACHE_CLASSES];  // Blocks in each class stack
+} tcache_t;
+
+static tcache_t *tcache_get(void);
+static void *tcache_malloc(size_t asize);
+static void tcache_free(void *bp);
+static void tcache_flush(tcache_t *tc, size_t index, unsigned int n);
+static void tcache_key_init(void);
+static void tcache_release(void *arg);
+static void heap_fork_prepare(void);
+static void heap_fork_parent(void);
+static void heap_fork_child(void);
+
+static __thread tcache_t tcache;
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile unsigned long heap_epoch = 0;
+#endif
 
 /*
  * mm_init - initialize the malloc package.
  */
 int mm_init(void) {
+#if THREAD_CACHE
+    // Every thread drops the blocks it cached from the previous heap
+    heap_epoch++;
+    pthread_once(&tcache_once, tcache_key_init);
+#endif
+
     // Create the initial emtpy heap
     if ((heap_listp = mem_sbrk(4 * WSIZE)) == (void *)-1) {
         return -1;
     }
 
-    PUT(heap_listp, 0);                                     // Alignment padding
-    PUT(heap_listp + (1 * WSIZE), PACK(DSIZE, ALLOC_BLK));  // Prologue header
-    PUT(heap_listp + (2 * WSIZE), PACK(DSIZE, ALLOC_BLK));  // Prologue footer
-    PUT(heap_listp + (3 * WSIZE), PACK(0, ALLOC_BLK));      // Epilogue header
+    PUT(heap_listp, 0);  // Alignment padding
+    PUT(heap_listp + (1 * WSIZE),
+        PACK(DSIZE, ALLOC_BLK | PREV_ALLOC_BLK));  // Prologue header
+    PUT(heap_listp + (2 * WSIZE),
+        PACK(DSIZE, ALLOC_BLK | PREV_ALLOC_BLK));  // Prologue footer
+    PUT(heap_listp + (3 * WSIZE),
+        PACK(0, ALLOC_BLK | PREV_ALLOC_BLK));  // Epilogue header
 
     // increments the pointer `heap_listp` to skip over the prologue block
     heap_listp = heap_listp + (2 * WSIZE);
 
-    for (size_t i = 0; i < SEG_LIST_LEN; i++) {
+    for (size_t i = 0; i < TREE_INDEX; i++) {
         free_listp[i] = NULL;
     }
+    free_treep = NULL;
+
+#if FASTBIN_MAX
+    memset(fastbin, 0, sizeof(fastbin));
+    fast_blocks = fast_hits = fast_misses = consolidations = 0;
+#endif
+
+#if SLAB_THRESHOLD
+    memset(slab_partial, 0, sizeof(slab_partial));
+    memset(slab_pages, 0, sizeof(slab_pages));
+    if (slab_map_init() < 0) {
+        return -1;
+    }
+#endif
 
     // Extend the empty heap with a free block of CHUNKSIZE bytes
     if (extend_heap(CHUNKSIZE / WSIZE) == NULL) {
@@ -126,20 +408,115 @@ int mm_init(void) {
  */
 void *mm_malloc(size_t size) {
     size_t asize;
-    size_t extend_size;
-    unsigned char *bp;
+    void *bp;
 
     if (size == 0) {
         return NULL;
     }
 
+#if SLAB_THRESHOLD
+    if (size <= SLAB_THRESHOLD) {
+        LOCK_HEAP();
+        bp = slab_malloc(size);
+        UNLOCK_HEAP();
+        return bp;
+    }
+#endif
+
+#if MMAP_THRESHOLD
+    if (size >= MMAP_THRESHOLD) {
+        LOCK_HEAP();
+        bp = map_malloc(size);
+        UNLOCK_HEAP();
+        return bp;
+    }
+#endif
+
+    asize = adjust_size(size);
+
+#if THREAD_CACHE
+    if (asize <= TCACHE_MAX_SIZE) {
+        return tcache_malloc(asize);
+    }
+#endif
+
+    LOCK_HEAP();
+    bp = malloc_block(asize);
+    UNLOCK_HEAP();
+    return bp;
+}
+
+/*
+ * mm_free - Return a block to the thread cache or the shared free lists.
+ */
+void mm_free(void *bp) {
+#if SLAB_THRESHOLD
+    slab_page_t *page;
+
+    if ((page = slab_page_of(bp)) != NULL) {
+        LOCK_HEAP();
+        slab_free(page, bp);
+        UNLOCK_HEAP();
+        return;
+    }
+#endif
+
+#if MMAP_THRESHOLD
+    if (GET_OWN(HDRP(bp)) & MAPPED_BLK) {
+        LOCK_HEAP();
+        map_free(bp);
+        UNLOCK_HEAP();
+        return;
+    }
+#endif
+
+#if THREAD_CACHE
+    if ((GET_OWN(HDRP(bp)) & ~0x7) <= TCACHE_MAX_SIZE) {
+        tcache_free(bp);
+        return;
+    }
+#endif
+
+    LOCK_HEAP();
+    free_block(bp);
+    UNLOCK_HEAP();
+}
+
+/*
+ * adjust_size - Round a request up to a block size that holds the header
+ * and keeps the payload aligned, and that can later hold the free-list links
+ * and footer once the block is freed.
+ */
+static size_t adjust_size(size_t size) {
     if (size <= DSIZE) {
-        asize = 2 * DSIZE;
-    } else {
-        asize = DSIZE * ((size + DSIZE + DSIZE - 1) / DSIZE);
+        return 2 * DSIZE;
+    }
+    return DSIZE * ((size + WSIZE + DSIZE - 1) / DSIZE);
+}
+
+/*
+ * malloc_block - Allocate a block of asize bytes from its fast bin or the
+ * shared free lists, consolidating the fast bins and then extending the heap
+ * if no free block fits.
+ */
+static void *malloc_block(size_t asize) {
+    size_t extend_size;
+    unsigned char *bp;
+
+#if FASTBIN_MAX
+    if (asize <= FASTBIN_MAX) {
+        if ((bp = fastbin[FASTBIN_INDEX(asize)]) != NULL) {
+            fastbin[FASTBIN_INDEX(asize)] = FASTBIN_NEXT(bp);
+            fast_blocks--;
+            fast_hits++;
+            return bp;
+        }
+        fast_misses++;
     }
+#endif
 
-    if ((bp = find_fit(asize)) != NULL) {
+    if ((bp = find_fit(asize)) != NULL ||
+        (consolidate() && (bp = find_fit(asize)) != NULL)) {
         place(bp, asize);
         return bp;
     }
@@ -153,14 +530,90 @@ void *mm_malloc(size_t size) {
 }
 
 /*
- * mm_free - Freeing a block does nothing.
+ * malloc_batch_blocks - Allocate n blocks of asize bytes from the shared free
+ * lists into out. Each pass takes the free block a single block would get
+ * and carves as many blocks from it as it holds, so holes are filled as they
+ * would be one block at a time; when none fits, the heap grows by the rest
+ * of the batch at once. Returns the blocks allocated.
  */
-void mm_free(void *bp) {
+static size_t malloc_batch_blocks(size_t asize, size_t n, void **out) {
+    size_t need, done = 0;
+    void *bp;
+
+    while (done < n) {
+        need = asize * MIN(n - done, MAX(BATCH_MAX / asize, 1));
+        if ((bp = find_fit(asize)) == NULL &&
+            (!consolidate() || (bp = find_fit(asize)) == NULL) &&
+            (bp = extend_heap(MAX(need, CHUNKSIZE) / WSIZE)) == NULL) {
+            break;
+        }
+        done += carve_batch(bp, asize, n - done, out + done);
+    }
+    return done;
+}
+
+/*
+ * free_block - Return a block to its fast bin, or to the shared free lists.
+ */
+static void free_block(void *bp) {
+#if FASTBIN_MAX
+    size_t size = GET_SIZE(HDRP(bp));
+
+    if (size <= FASTBIN_MAX) {
+        FASTBIN_NEXT(bp) = fastbin[FASTBIN_INDEX(size)];
+        fastbin[FASTBIN_INDEX(size)] = bp;
+        fast_blocks++;
+        return;
+    }
+#endif
+    release_block(bp);
+}
+
+/*
+ * release_block - Mark block bp free, coalesce it and put it on the shared
+ * free lists, trimming the heap if that leaves a large free block at its end.
+ */
+static void release_block(void *bp) {
     size_t size = GET_SIZE(HDRP(bp));
 
-    PUT(HDRP(bp), PACK(size, FREE_BLK));
+    PUT(HDRP(bp), PACK(size, FREE_BLK | GET_PREV_ALLOC(HDRP(bp))));
     PUT(FTRP(bp), PACK(size, FREE_BLK));
-    coalesce(bp);
+    CLR_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+    bp = coalesce(bp);
+
+#if TRIM_THRESHOLD
+    if (GET_SIZE(HDRP(bp)) >= TRIM_THRESHOLD &&
+        GET_SIZE(HDRP(NEXT_BLKP(bp))) == 0) {
+        trim_heap(TRIM_PAD);
+    }
+#endif
+}
+
+/*
+ * consolidate - Empty the fast bins into the shared free lists, coalescing
+ * every block. Returns the number of blocks released.
+ */
+static int consolidate(void) {
+#if FASTBIN_MAX
+    int i, n = 0;
+    void *bp;
+
+    if (fast_blocks == 0) {
+        return 0;
+    }
+    for (i = 0; i < FASTBIN_COUNT; i++) {
+        while ((bp = fastbin[i]) != NULL) {
+            fastbin[i] = FASTBIN_NEXT(bp);
+            release_block(bp);
+            n++;
+        }
+    }
+    fast_blocks = 0;
+    consolidations++;
+    return n;
+#else
+    return 0;
+#endif
 }
 
 /*
@@ -168,7 +621,7 @@ void mm_free(void *bp) {
  * fragmentation.
  */
 static void *coalesce(void *bp) {
-    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
     size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
     size_t size = GET_SIZE(HDRP(bp));
 
@@ -177,7 +630,7 @@ static void *coalesce(void *bp) {
     if (prev_alloc && !next_alloc) {
         detach_free_list(NEXT_BLKP(bp));
         size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
-        PUT(HDRP(bp), PACK(size, FREE_BLK));
+        PUT(HDRP(bp), PACK(size, FREE_BLK | PREV_ALLOC_BLK));
         PUT(FTRP(bp), PACK(size, FREE_BLK));
     }
 
@@ -186,7 +639,8 @@ static void *coalesce(void *bp) {
         detach_free_list(PREV_BLKP(bp));
         size += GET_SIZE(HDRP(PREV_BLKP(bp)));
         PUT(FTRP(bp), PACK(size, FREE_BLK));
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size, FREE_BLK));
+        PUT(HDRP(PREV_BLKP(bp)),
+            PACK(size, FREE_BLK | GET_PREV_ALLOC(HDRP(PREV_BLKP(bp)))));
         bp = PREV_BLKP(bp);
     }
 
@@ -194,9 +648,10 @@ static void *coalesce(void *bp) {
     else if (!prev_alloc && !next_alloc) {
         detach_free_list(PREV_BLKP(bp));
         detach_free_list(NEXT_BLKP(bp));
-        size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(FTRP(NEXT_BLKP(bp)));
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size, FREE_BLK));
+        size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(HDRP(NEXT_BLKP(bp)));
         PUT(FTRP(NEXT_BLKP(bp)), PACK(size, FREE_BLK));
+        PUT(HDRP(PREV_BLKP(bp)),
+            PACK(size, FREE_BLK | GET_PREV_ALLOC(HDRP(PREV_BLKP(bp)))));
         bp = PREV_BLKP(bp);
     }
 
@@ -208,10 +663,265 @@ static void *coalesce(void *bp) {
  * mm_realloc - Implemented simply in terms of mm_malloc and mm_free
  */
 void *mm_realloc(void *bp, size_t size) {
+    void *new_ptr;
+
+    LOCK_HEAP();
+    new_ptr = realloc_block(bp, size);
+    UNLOCK_HEAP();
+    return new_ptr;
+}
+
+/*
+ * mm_memalign - Allocate a block whose payload is aligned to alignment bytes,
+ * a power of two. It is carved out of a free block, and the slack on either
+ * side goes back to the free lists.
+ */
+void *mm_memalign(size_t alignment, size_t size) {
+    void *bp;
+
+    if (alignment <= ALIGNMENT) {
+        return mm_malloc(size);
+    }
+    if (size == 0 || (alignment & (alignment - 1)) != 0) {
+        return NULL;
+    }
+
+    LOCK_HEAP();
+    bp = malloc_aligned_block(adjust_size(size), alignment);
+    UNLOCK_HEAP();
+    return bp;
+}
+
+/*
+ * mm_posix_memalign - mm_memalign with the interface of posix_memalign.
+ */
+int mm_posix_memalign(void **memptr, size_t alignment, size_t size) {
+    void *bp;
+
+    if (alignment % sizeof(void *) != 0 ||
+        (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    if ((bp = mm_memalign(alignment, size)) == NULL && size != 0) {
+        return ENOMEM;
+    }
+    *memptr = bp;
+    return 0;
+}
+
+/*
+ * mm_calloc - Allocate a zeroed array of nmemb elements of size bytes. Small
+ * blocks are mostly recycled ones and cheap to clear, so they are simply
+ * cleared; a new mapping is zero already, and so is a heap block carved
+ * from heap that mem_sbrk had never handed out, but for what the allocator
+ * wrote into it.
+ */
+void *mm_calloc(size_t nmemb, size_t size) {
+    unsigned char *fresh;
+    size_t bytes, asize;
+    int small;
+    void *bp;
+
+    if (size != 0 && nmemb > SIZE_MAX / size) {
+        return NULL;
+    }
+    // No block, in the heap or mapped, has a size field that could record
+    // more, and adjust_size can't wrap below it
+    if ((bytes = nmemb * size) == 0 || bytes > MAX_REQUEST) {
+        return NULL;
+    }
+
+#if MMAP_THRESHOLD
+    if (bytes >= MMAP_THRESHOLD) {
+        LOCK_HEAP();
+        bp = map_malloc(bytes);
+        UNLOCK_HEAP();
+        return bp;
+    }
+#endif
+
+    asize = adjust_size(bytes);
+    small = bytes <= SLAB_THRESHOLD;
+#if THREAD_CACHE
+    small = small || asize <= TCACHE_MAX_SIZE;
+#endif
+    if (small) {
+        if ((bp = mm_malloc(bytes)) != NULL) {
+            memset(bp, 0, bytes);
+        }
+        return bp;
+    }
+
+    // Heap is only handed out under the lock, so no other thread can have
+    // dirtied what lies above fresh
+    LOCK_HEAP();
+    fresh = mem_fresh_lo();
+    bp = malloc_block(asize);
+    UNLOCK_HEAP();
+    if (bp == NULL) {
+        return NULL;
+    }
+
+    if ((unsigned char *)bp >= fresh) {
+        clear_fresh(bp, bytes);
+    } else {
+        memset(bp, 0, bytes);
+    }
+    return bp;
+}
+
+/*
+ * mm_malloc_batch - Allocate n blocks of size bytes into out under a single
+ * hold of the heap. Heap blocks are carved side by side from as few free
+ * blocks as possible, bypassing the thread cache. Returns the blocks
+ * allocated, which is less than n only if memory ran out.
+ */
+size_t mm_malloc_batch(size_t size, size_t n, void **out) {
+    size_t done = 0;
+
+    if (size == 0) {
+        return 0;
+    }
+
+    LOCK_HEAP();
+#if SLAB_THRESHOLD
+    if (size <= SLAB_THRESHOLD) {
+        while (done < n && (out[done] = slab_malloc(size)) != NULL) {
+            done++;
+        }
+        UNLOCK_HEAP();
+        return done;
+    }
+#endif
+#if MMAP_THRESHOLD
+    if (size >= MMAP_THRESHOLD) {
+        while (done < n && (out[done] = map_malloc(size)) != NULL) {
+            done++;
+        }
+        UNLOCK_HEAP();
+        return done;
+    }
+#endif
+    done = malloc_batch_blocks(adjust_size(size), n, out);
+    UNLOCK_HEAP();
+    return done;
+}
+
+/*
+ * mm_free_batch - Free the n blocks in ptrs under a single hold of the heap.
+ * Slab slots and mappings are freed as they come, and the heap blocks are
+ * sorted by address at the front of ptrs, so that neighbours in the heap are
+ * freed together as one block: each run is coalesced and inserted into its
+ * free list only once.
+ */
+void mm_free_batch(void **ptrs, size_t n) {
+    unsigned char *bp;
+    size_t i, m, size;
+#if SLAB_THRESHOLD
+    slab_page_t *page;
+#endif
+
+    LOCK_HEAP();
+    for (i = m = 0; i < n; i++) {
+        if ((bp = ptrs[i]) == NULL) {
+            continue;
+        }
+#if SLAB_THRESHOLD
+        if ((page = slab_page_of(bp)) != NULL) {
+            slab_free(page, bp);
+            continue;
+        }
+#endif
+#if MMAP_THRESHOLD
+        if (GET_OWN(HDRP(bp)) & MAPPED_BLK) {
+            map_free(bp);
+            continue;
+        }
+#endif
+        ptrs[m++] = bp;
+    }
+
+    sort_ptrs(ptrs, m);
+    for (i = 0; i < m; i++) {
+        bp = ptrs[i];
+        size = GET_SIZE(HDRP(bp));
+        while (i + 1 < m && (unsigned char *)ptrs[i + 1] == bp + size) {
+            size += GET_SIZE(HDRP(ptrs[++i]));
+        }
+        PUT(HDRP(bp), PACK(size, ALLOC_BLK | GET_PREV_ALLOC(HDRP(bp))));
+        release_block(bp);
+    }
+    UNLOCK_HEAP();
+}
+
+/*
+ * mm_usable_size - Return the bytes the caller may use at bp, which can be
+ * more than were asked for.
+ */
+size_t mm_usable_size(void *bp) {
+#if SLAB_THRESHOLD
+    slab_page_t *page;
+
+    if ((page = slab_page_of(bp)) != NULL) {
+        return SLAB_SLOT_SIZE(page->index);
+    }
+#endif
+#if MMAP_THRESHOLD
+    if (GET_OWN(HDRP(bp)) & MAPPED_BLK) {
+        return (GET_OWN(HDRP(bp)) & ~0x7) - DSIZE;
+    }
+#endif
+    // An allocated block has no footer
+    return (GET_OWN(HDRP(bp)) & ~0x7) - WSIZE;
+}
+
+/*
+ * realloc_block - Resize a block while holding the heap.
+ */
+static void *realloc_block(void *bp, size_t size) {
     void *old_ptr = bp;
     void *new_ptr;
-    size_t old_size = GET_SIZE(HDRP(old_ptr));
-    size_t new_size = ALIGN(size + DSIZE);  // Add header, footer byte
+    size_t old_size;
+    size_t new_size = adjust_size(size);  // Add header, footer byte
+
+#if SLAB_THRESHOLD
+    slab_page_t *page;
+
+    if ((page = slab_page_of(bp)) != NULL) {
+        return slab_realloc(page, bp, size);
+    }
+#endif
+#if MMAP_THRESHOLD
+    if (GET_MAPPED(HDRP(bp))) {
+        return map_realloc(bp, size);
+    }
+#endif
+    old_size = GET_SIZE(HDRP(old_ptr));
+
+#if MMAP_THRESHOLD
+    // Grown past the threshold: move the block into a mapping of its own
+    if (size >= MMAP_THRESHOLD) {
+        if ((new_ptr = map_malloc(size)) == NULL) return NULL;
+        memcpy(new_ptr, old_ptr, MIN(old_size - WSIZE, size));
+        free_block(bp);
+        return new_ptr;
+    }
+#endif
+
+    // Growing the last block, or the block before a free block that ends the
+    // heap: extend the heap behind it so Case 3 can grow it in place
+    if (new_size > old_size) {
+        void *next = NEXT_BLKP(old_ptr);
+        size_t avail = old_size;
+
+        if (!GET_ALLOC(HDRP(next))) {
+            avail += GET_SIZE(HDRP(next));
+            next = NEXT_BLKP(next);
+        }
+        if (GET_SIZE(HDRP(next)) == 0 && avail < new_size) {
+            extend_heap(MAX(new_size - avail, CHUNKSIZE) / WSIZE);
+        }
+    }
 
     // Case 1: Requested size is equal to the current size
     if (new_size == old_size) {
@@ -221,11 +931,13 @@ void *mm_realloc(void *bp, size_t size) {
     // Case 2: Requested size is smaller than the current size
     else if (new_size < old_size) {
         if ((old_size - new_size) >= (2 * DSIZE)) {
-            PUT(HDRP(old_ptr), PACK(new_size, ALLOC_BLK));
-            PUT(FTRP(old_ptr), PACK(new_size, ALLOC_BLK));
-            PUT(HDRP(NEXT_BLKP(old_ptr)), PACK(old_size - new_size, FREE_BLK));
+            PUT(HDRP(old_ptr),
+                PACK(new_size, ALLOC_BLK | GET_PREV_ALLOC(HDRP(old_ptr))));
+            PUT(HDRP(NEXT_BLKP(old_ptr)),
+                PACK(old_size - new_size, FREE_BLK | PREV_ALLOC_BLK));
             PUT(FTRP(NEXT_BLKP(old_ptr)), PACK(old_size - new_size, FREE_BLK));
-            attach_free_list(NEXT_BLKP(old_ptr), old_size - new_size);
+            CLR_PREV_ALLOC(HDRP(NEXT_BLKP(NEXT_BLKP(old_ptr))));
+            coalesce(NEXT_BLKP(old_ptr));
         }
         return old_ptr;
     }
@@ -236,58 +948,140 @@ void *mm_realloc(void *bp, size_t size) {
         detach_free_list(NEXT_BLKP(old_ptr));
 
         size_t extended_size = old_size + GET_SIZE(HDRP(NEXT_BLKP(old_ptr)));
+        size_t prev_alloc = GET_PREV_ALLOC(HDRP(old_ptr));
 
         if ((extended_size - new_size) >= (2 * DSIZE)) {
-            PUT(HDRP(old_ptr), PACK(new_size, ALLOC_BLK));
-            PUT(FTRP(old_ptr), PACK(new_size, ALLOC_BLK));
+            PUT(HDRP(old_ptr), PACK(new_size, ALLOC_BLK | prev_alloc));
             PUT(HDRP(NEXT_BLKP(old_ptr)),
-                PACK(extended_size - new_size, FREE_BLK));
+                PACK(extended_size - new_size, FREE_BLK | PREV_ALLOC_BLK));
             PUT(FTRP(NEXT_BLKP(old_ptr)),
                 PACK(extended_size - new_size, FREE_BLK));
             attach_free_list(NEXT_BLKP(old_ptr), extended_size - new_size);
         } else {
-            PUT(HDRP(old_ptr), PACK(extended_size, ALLOC_BLK));
-            PUT(FTRP(old_ptr), PACK(extended_size, ALLOC_BLK));
+            PUT(HDRP(old_ptr), PACK(extended_size, ALLOC_BLK | prev_alloc));
+            SET_PREV_ALLOC(HDRP(NEXT_BLKP(old_ptr)));
         }
         return old_ptr;
     }
 
     // Case 4: Combine with the previous free block
-    else if (!GET_ALLOC(HDRP(PREV_BLKP(old_ptr))) &&
+    else if (!GET_PREV_ALLOC(HDRP(old_ptr)) &&
              (old_size + GET_SIZE(HDRP(PREV_BLKP(old_ptr)))) >= new_size) {
         detach_free_list(PREV_BLKP(old_ptr));
 
         size_t extended_size = old_size + GET_SIZE(HDRP(PREV_BLKP(old_ptr)));
         old_ptr = PREV_BLKP(old_ptr);
 
+        // A free block always follows an allocated one
+        memmove(old_ptr, bp, old_size - WSIZE);
         if ((extended_size - new_size) >= (2 * DSIZE)) {
-            memmove(old_ptr, NEXT_BLKP(old_ptr),
-                    GET_SIZE(HDRP(NEXT_BLKP(old_ptr))) - (DSIZE));
-            PUT(HDRP(old_ptr), PACK(new_size, ALLOC_BLK));
-            PUT(FTRP(old_ptr), PACK(new_size, ALLOC_BLK));
+            PUT(HDRP(old_ptr), PACK(new_size, ALLOC_BLK | PREV_ALLOC_BLK));
             PUT(HDRP(NEXT_BLKP(old_ptr)),
-                PACK(extended_size - new_size, FREE_BLK));
+                PACK(extended_size - new_size, FREE_BLK | PREV_ALLOC_BLK));
             PUT(FTRP(NEXT_BLKP(old_ptr)),
                 PACK(extended_size - new_size, FREE_BLK));
+            CLR_PREV_ALLOC(HDRP(NEXT_BLKP(NEXT_BLKP(old_ptr))));
             attach_free_list(NEXT_BLKP(old_ptr), extended_size - new_size);
         } else {
-            memmove(old_ptr, NEXT_BLKP(old_ptr),
-                    GET_SIZE(HDRP(NEXT_BLKP(old_ptr))) - (DSIZE));
-            PUT(HDRP(old_ptr), PACK(extended_size, ALLOC_BLK));
-            PUT(FTRP(old_ptr), PACK(extended_size, ALLOC_BLK));
+            PUT(HDRP(old_ptr), PACK(extended_size, ALLOC_BLK | PREV_ALLOC_BLK));
         }
         return old_ptr;
     }
 
     // Case 5: Allocate a new block and free the old block
     else {
-        new_ptr = mm_malloc(new_size);
+        new_ptr = malloc_block(new_size);
         if (new_ptr == NULL) return NULL;
-        memcpy(new_ptr, old_ptr, old_size);
-        mm_free(bp);
+        memcpy(new_ptr, old_ptr, old_size - WSIZE);
+        free_block(bp);
         return new_ptr;
     }
 }
+
+/*
+ * mm_trim - Give the free space at the end of the heap back to memlib,
+ * keeping pad bytes of it. Returns 1 if the heap shrank.
+ */
+int mm_trim(size_t pad) {
+    int trimmed;
+
+    LOCK_HEAP();
+    consolidate();  // A fast block at the end of the heap would hold it up
+    trimmed = trim_heap(pad);
+    UNLOCK_HEAP();
+    return trimmed;
+}
+
+/*
+ * trim_heap - Shrink the free block that ends the heap to pad bytes, or drop
+ * it entirely when pad is 0, while holding the heap.
+ */
+static int trim_heap(size_t pad) {
+    unsigned char *epilogue = (unsigned char *)mem_heap_hi() + 1 - WSIZE;
+    size_t size, keep;
+    void *bp;
+
+    // The block before the epilogue must be free
+    if (GET_PREV_ALLOC(epilogue)) {
+        return 0;
+    }
+    size = GET_SIZE(epilogue - WSIZE);
+    bp = epilogue - size + WSIZE;
+
+    // What stays behind must still be a valid free block
+    keep = DSIZE * ((pad + (DSIZE - 1)) / DSIZE);
+    if (keep != 0 && keep < 2 * DSIZE) {
+        keep = 2 * DSIZE;
+    }
+    if (keep >= size) {
+        return 0;
+    }
+
+    detach_free_list(bp);
+    if (keep == 0) {
+        PUT(HDRP(bp), PACK(0, ALLOC_BLK | GET_PREV_ALLOC(HDRP(bp))));
+    } else {
+        PUT(HDRP(bp), PACK(keep, FREE_BLK | GET_PREV_ALLOC(HDRP(bp))));
+        PUT(FTRP(bp), PACK(keep, FREE_BLK));
+        PUT(HDRP(NEXT_BLKP(bp)), PACK(0, ALLOC_BLK));  // New epilogue header
+        attach_free_list(bp, keep);
+    }
+    mem_sbrk(-(int)(size - keep));
+    return 1;
+}
+
+/*
+ * mm_heapstats - Count the free blocks by walking the heap, and sort them
+ * into the size classes of the segregated lists. Blocks sitting in thread
+ * caches, fast bins or slab pages count as allocated.
+ */
+int mm_heapstats(mm_heapstats_t *stats) {
+    size_t size;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->nbins = SEG_LIST_LEN;
+
+    LOCK_HEAP();
+#if FASTBIN_MAX
+    stats->fast_blocks = fast_blocks;
+    stats->fast_hits = fast_hits;
+    stats->fast_misses = fast_misses;
+    stats->consolidations = consolidations;
+#endif
+    for (void *bp = heap_listp; (size = GET_SIZE(HDRP(bp))) != 0;
+         bp = NEXT_BLKP(bp)) {
+        if (GET_ALLOC(HDRP(bp))) {
+            continue;
+        }
+        stats->free_blocks++;
+        stats->free_bytes += size;
+        stats->largest_free = MAX(stats->largest_free, size);
+        stats->bin_blocks[asize_to_index(size)]++;
+    }
+    UNLOCK_HEAP();
+    return 0;
+}
+
 /*
  * extend_heap - Extend the heap by allocating a new free block.
  */
@@ -301,8 +1095,9 @@ static void *extend_heap(size_t words) {
         return NULL;
     }
 
-    // Initialize free block header/footer and the epilogue header
-    PUT(HDRP(bp), PACK(size, FREE_BLK));           // Free block header
+    // Initialize free block header/footer and the epilogue header. The new
+    // block takes over the old epilogue's previous-allocated bit.
+    PUT(HDRP(bp), PACK(size, FREE_BLK | GET_PREV_ALLOC(HDRP(bp))));
     PUT(FTRP(bp), PACK(size, FREE_BLK));           // Free block footer
     PUT(HDRP(NEXT_BLKP(bp)), PACK(0, ALLOC_BLK));  // New epilogue header
 
@@ -319,7 +1114,7 @@ static void *find_fit(size_t asize) {
 
     // Iterate through the segregated free list starting from the determined
     // index
-    for (size_t i = start_index; i < SEG_LIST_LEN; i++) {
+    for (size_t i = start_index; i < TREE_INDEX; i++) {
         if (free_listp[i] == NULL) {
             continue;
         }
@@ -332,7 +1127,8 @@ static void *find_fit(size_t asize) {
         }
     }
 
-    return NULL;
+    // Large requests, or no small block fits: best fit from the tree
+    return tree_find_fit(asize);
 }
 
 /*
@@ -345,17 +1141,16 @@ static void place(void *bp, size_t asize) {
 
     // Check if splitting the block is necessary
     if ((csize - asize) >= (2 * DSIZE)) {
-        PUT(HDRP(bp), PACK(asize, ALLOC_BLK));
-        PUT(FTRP(bp), PACK(asize, ALLOC_BLK));
+        PUT(HDRP(bp), PACK(asize, ALLOC_BLK | GET_PREV_ALLOC(HDRP(bp))));
         bp = NEXT_BLKP(bp);
-        PUT(HDRP(bp), PACK(csize - asize, FREE_BLK));
+        PUT(HDRP(bp), PACK(csize - asize, FREE_BLK | PREV_ALLOC_BLK));
         PUT(FTRP(bp), PACK(csize - asize, FREE_BLK));
         coalesce(bp);
     }
     // Allocate the entire block without splitting
     else {
-        PUT(HDRP(bp), PACK(csize, ALLOC_BLK));
-        PUT(FTRP(bp), PACK(csize, ALLOC_BLK));
+        PUT(HDRP(bp), PACK(csize, ALLOC_BLK | GET_PREV_ALLOC(HDRP(bp))));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
     }
 }
 
@@ -369,6 +1164,11 @@ static void *attach_free_list(void *bp, size_t asize) {
 
     size_t index = asize_to_index(asize);
 
+    if (index >= TREE_INDEX) {
+        free_treep = tree_insert(free_treep, bp);
+        return bp;
+    }
+
     next_bp = free_listp[index];
 
     // Find the appropriate position in the free list based on block size
@@ -381,29 +1181,29 @@ static void *attach_free_list(void *bp, size_t asize) {
     if (next_bp != NULL) {
         // Insert the block between prev_bp and next_bp
         if (prev_bp != NULL) {
-            SUCC(bp) = next_bp;
-            PRED(bp) = prev_bp;
-            PRED(next_bp) = bp;
-            SUCC(prev_bp) = bp;
+            SET_SUCC(bp, next_bp);
+            SET_PRED(bp, prev_bp);
+            SET_PRED(next_bp, bp);
+            SET_SUCC(prev_bp, bp);
         }
         // Insert the block at the beginning of the free list
         else {
-            SUCC(bp) = next_bp;
-            PRED(bp) = NULL;
-            PRED(next_bp) = bp;
+            SET_SUCC(bp, next_bp);
+            SET_PRED(bp, NULL);
+            SET_PRED(next_bp, bp);
             free_listp[index] = bp;
         }
     } else {
         // Insert the block at the end of the free list
         if (prev_bp != NULL) {
-            SUCC(bp) = NULL;
-            PRED(bp) = prev_bp;
-            SUCC(prev_bp) = bp;
+            SET_SUCC(bp, NULL);
+            SET_PRED(bp, prev_bp);
+            SET_SUCC(prev_bp, bp);
         }
         // The free list is empty, insert the block as the only element
         else {
-            SUCC(bp) = NULL;
-            PRED(bp) = NULL;
+            SET_SUCC(bp, NULL);
+            SET_PRED(bp, NULL);
             free_listp[index] = bp;
         }
     }
@@ -418,6 +1218,11 @@ static void *detach_free_list(void *bp) {
     size_t asize = GET_SIZE(HDRP(bp));
     size_t index = asize_to_index(asize);
 
+    if (index >= TREE_INDEX) {
+        free_treep = tree_remove(free_treep, bp);
+        return bp;
+    }
+
     // Check if the block is at the beginning of the free list
     if (bp == free_listp[index]) {
         free_listp[index] = SUCC(bp);
@@ -425,13 +1230,13 @@ static void *detach_free_list(void *bp) {
 
     // Check if the block is at the end of the free list
     else if (SUCC(bp) == NULL) {
-        SUCC(PRED(bp)) = NULL;
+        SET_SUCC(PRED(bp), NULL);
     }
 
     // The block is in the middle of the free list
     else if (SUCC(bp) != NULL) {
-        SUCC(PRED(bp)) = SUCC(bp);
-        PRED(SUCC(bp)) = PRED(bp);
+        SET_SUCC(PRED(bp), SUCC(bp));
+        SET_PRED(SUCC(bp), PRED(bp));
     }
 
     return bp;
@@ -462,4 +1267,673 @@ static size_t asize_to_index(size_t asize) {
         index = SEG_LIST_LEN - 1;
     }
     return index;
-}
\ No newline at end of file
+}
+
+/*
+ * tree_find_fit - Return the smallest free block of at least asize bytes from
+ * the large block tree, taking the lowest address among equal sizes.
+ */
+static void *tree_find_fit(size_t asize) {
+    void *fit = NULL;
+    void *node = free_treep;
+
+    while (node != NULL) {
+        if (GET_SIZE(HDRP(node)) >= asize) {
+            fit = node;
+            node = TREE_LEFT(node);
+        } else {
+            node = TREE_RIGHT(node);
+        }
+    }
+    return fit;
+}
+
+/*
+ * tree_insert - Insert free block bp into the subtree rooted at node and
+ * return the new subtree root.
+ */
+static void *tree_insert(void *node, void *bp) {
+    if (node == NULL) {
+        TREE_LEFT(bp) = NULL;
+        TREE_RIGHT(bp) = NULL;
+        TREE_HEIGHT(bp) = 1;
+        return bp;
+    }
+
+    if (tree_less(bp, node)) {
+        TREE_LEFT(node) = tree_insert(TREE_LEFT(node), bp);
+    } else {
+        TREE_RIGHT(node) = tree_insert(TREE_RIGHT(node), bp);
+    }
+    return tree_balance(node);
+}
+
+/*
+ * tree_remove - Remove free block bp from the subtree rooted at node and
+ * return the new subtree root. The header of bp must still hold the size it
+ * was inserted with.
+ */
+static void *tree_remove(void *node, void *bp) {
+    void *min;
+
+    if (node == bp) {
+        // Replace bp by its in-order successor
+        if (TREE_RIGHT(node) == NULL) {
+            return TREE_LEFT(node);
+        }
+        TREE_RIGHT(node) = tree_remove_min(TREE_RIGHT(node), &min);
+        TREE_LEFT(min) = TREE_LEFT(node);
+        TREE_RIGHT(min) = TREE_RIGHT(node);
+        return tree_balance(min);
+    }
+
+    if (tree_less(bp, node)) {
+        TREE_LEFT(node) = tree_remove(TREE_LEFT(node), bp);
+    } else {
+        TREE_RIGHT(node) = tree_remove(TREE_RIGHT(node), bp);
+    }
+    return tree_balance(node);
+}
+
+/*
+ * tree_remove_min - Unlink the leftmost block of the subtree rooted at node,
+ * store it in *min and return the new subtree root.
+ */
+static void *tree_remove_min(void *node, void **min) {
+    if (TREE_LEFT(node) == NULL) {
+        *min = node;
+        return TREE_RIGHT(node);
+    }
+    TREE_LEFT(node) = tree_remove_min(TREE_LEFT(node), min);
+    return tree_balance(node);
+}
+
+/*
+ * tree_balance - Recompute the height of node and rotate it back into AVL
+ * shape if its subtrees differ in height by two.
+ */
+static void *tree_balance(void *node) {
+    int left = tree_height(TREE_LEFT(node));
+    int right = tree_height(TREE_RIGHT(node));
+
+    if (left > right + 1) {
+        void *child = TREE_LEFT(node);
+        if (tree_height(TREE_LEFT(child)) < tree_height(TREE_RIGHT(child))) {
+            TREE_LEFT(node) = tree_rotate_left(child);
+        }
+        return tree_rotate_right(node);
+    }
+    if (right > left + 1) {
+        void *child = TREE_RIGHT(node);
+        if (tree_height(TREE_RIGHT(child)) < tree_height(TREE_LEFT(child))) {
+            TREE_RIGHT(node) = tree_rotate_right(child);
+        }
+        return tree_rotate_left(node);
+    }
+
+    TREE_HEIGHT(node) = MAX(left, right) + 1;
+    return node;
+}
+
+/*
+ * tree_rotate_left - Lift the right child of node above it.
+ */
+static void *tree_rotate_left(void *node) {
+    void *child = TREE_RIGHT(node);
+
+    TREE_RIGHT(node) = TREE_LEFT(child);
+    TREE_LEFT(child) = node;
+    TREE_HEIGHT(node) = MAX(tree_height(TREE_LEFT(node)),
+                            tree_height(TREE_RIGHT(node))) + 1;
+    TREE_HEIGHT(child) = MAX(tree_height(TREE_LEFT(child)),
+                             tree_height(TREE_RIGHT(child))) + 1;
+    return child;
+}
+
+/*
+ * tree_rotate_right - Lift the left child of node above it.
+ */
+static void *tree_rotate_right(void *node) {
+    void *child = TREE_LEFT(node);
+
+    TREE_LEFT(node) = TREE_RIGHT(child);
+    TREE_RIGHT(child) = node;
+    TREE_HEIGHT(node) = MAX(tree_height(TREE_LEFT(node)),
+                            tree_height(TREE_RIGHT(node))) + 1;
+    TREE_HEIGHT(child) = MAX(tree_height(TREE_LEFT(child)),
+                             tree_height(TREE_RIGHT(child))) + 1;
+    return child;
+}
+
+/*
+ * tree_height - Height of the subtree rooted at node, 0 if it is empty.
+ */
+static int tree_height(void *node) {
+    return node == NULL ? 0 : TREE_HEIGHT(node);
+}
+
+/*
+ * tree_less - Order free blocks by size, then by address.
+ */
+static int tree_less(void *a, void *b) {
+    size_t asize = GET_SIZE(HDRP(a));
+    size_t bsize = GET_SIZE(HDRP(b));
+
+    return asize < bsize || (asize == bsize && a < b);
+}
+
+#if MMAP_THRESHOLD
+/*
+ * map_malloc - Serve a request from a mapping of its own. The payload starts
+ * DSIZE bytes in, behind a header holding the mapping length.
+ */
+static void *map_malloc(size_t size) {
+    size_t len = map_len(size);
+    unsigned char *map;
+
+    if (len == 0 || (map = mem_map(len)) == NULL) {
+        return NULL;
+    }
+    PUT(map + DSIZE - WSIZE, PACK(len, ALLOC_BLK | MAPPED_BLK));
+    return map + DSIZE;
+}
+
+/*
+ * map_free - Give the mapping of block bp back to memlib.
+ */
+static void map_free(void *bp) {
+    mem_unmap((unsigned char *)bp - DSIZE, GET_SIZE(HDRP(bp)));
+}
+
+/*
+ * map_realloc - Resize the mapping of block bp, which may move it.
+ */
+static void *map_realloc(void *bp, size_t size) {
+    size_t old_len = GET_SIZE(HDRP(bp));
+    size_t len = map_len(size);
+    unsigned char *map;
+
+    if (len == old_len) {
+        return bp;
+    }
+    if (len == 0 ||
+        (map = mem_remap((unsigned char *)bp - DSIZE, old_len, len)) == NULL) {
+        return NULL;
+    }
+    PUT(map + DSIZE - WSIZE, PACK(len, ALLOC_BLK | MAPPED_BLK));
+    return map + DSIZE;
+}
+
+/*
+ * map_len - Length of the mapping for a request of size bytes, or 0 if the
+ * header can't record it.
+ */
+static size_t map_len(size_t size) {
+    size_t pagesize = mem_pagesize();
+    size_t len = (size + DSIZE + pagesize - 1) & ~(pagesize - 1);
+
+    return len > 0xFFFFFFF8 ? 0 : len;
+}
+#endif
+
+#if THREAD_CACHE
+/*
+ * tcache_get - Return the calling thread's cache, emptying it if its blocks
+ * came from a heap that mm_init has since discarded.
+ */
+static tcache_t *tcache_get(void) {
+    tcache_t *tc = &tcache;
+
+    if (tc->epoch != heap_epoch) {
+        memset(tc, 0, sizeof(*tc));
+        tc->epoch = heap_epoch;
+
+        // Register the cache so it is flushed when the thread exits
+        pthread_once(&tcache_once, tcache_key_init);
+        pthread_setspecific(tcache_key, tc);
+    }
+    return tc;
+}
+
+/*
+ * tcache_malloc - Pop a block of class asize from the thread cache, first
+ * refilling the stack with a batch from the shared lists if it is empty.
+ */
+static void *tcache_malloc(size_t asize) {
+    tcache_t *tc = tcache_get();
+    size_t index = TCACHE_INDEX(asize);
+    void *bp;
+
+    if (tc->head[index] == NULL) {
+        LOCK_HEAP();
+        for (unsigned int i = 0; i < TCACHE_BATCH; i++) {
+            if ((bp = malloc_block(asize)) == NULL) {
+                break;
+            }
+            TCACHE_NEXT(bp) = tc->head[index];
+            tc->head[index] = bp;
+            tc->count[index]++;
+        }
+        UNLOCK_HEAP();
+
+        if (tc->head[index] == NULL) {
+            return NULL;
+        }
+    }
+
+    bp = tc->head[index];
+    tc->head[index] = TCACHE_NEXT(bp);
+    tc->count[index]--;
+    return bp;
+}
+
+/*
+ * tcache_free - Push a small block onto the thread cache, first flushing a
+ * batch back to the shared lists if the stack is full.
+ */
+static void tcache_free(void *bp) {
+    tcache_t *tc = tcache_get();
+    size_t index = TCACHE_INDEX(GET_OWN(HDRP(bp)) & ~0x7);
+
+    if (tc->count[index] >= TCACHE_DEPTH) {
+        tcache_flush(tc, index, TCACHE_BATCH);
+    }
+
+    TCACHE_NEXT(bp) = tc->head[index];
+    tc->head[index] = bp;
+    tc->count[index]++;
+}
+
+/*
+ * tcache_flush - Return up to n cached blocks of one class to the shared
+ * lists under a single lock acquisition.
+ */
+static void tcache_flush(tcache_t *tc, size_t index, unsigned int n) {
+    void *bp;
+
+    LOCK_HEAP();
+    while (n-- > 0 && (bp = tc->head[index]) != NULL) {
+        tc->head[index] = TCACHE_NEXT(bp);
+        tc->count[index]--;
+        free_block(bp);
+    }
+    UNLOCK_HEAP();
+}
+
+/*
+ * tcache_key_init - Create the key whose destructor runs at thread exit, and
+ * keep the heap lock consistent across fork.
+ */
+static void tcache_key_init(void) {
+    pthread_key_create(&tcache_key, tcache_release);
+    pthread_atfork(heap_fork_prepare, heap_fork_parent, heap_fork_child);
+}
+
+/*
+ * heap_fork_prepare, heap_fork_parent, heap_fork_child - Hold the heap across
+ * fork, so the child never inherits it locked by a thread it doesn't have.
+ */
+static void heap_fork_prepare(void) {
+    LOCK_HEAP();
+}
+
+static void heap_fork_parent(void) {
+    UNLOCK_HEAP();
+}
+
+static void heap_fork_child(void) {
+    pthread_mutex_init(&heap_lock, NULL);
+}
+
+/*
+ * tcache_release - Give an exiting thread's cached blocks back to the heap.
+ */
+static void tcache_release(void *arg) {
+    tcache_t *tc = arg;
+
+    if (tc->epoch != heap_epoch) {
+        return;
+    }
+    for (size_t i = 0; i < TCACHE_CLASSES; i++) {
+        tcache_flush(tc, i, tc->count[i]);
+    }
+}
+#endif
+
+#if SLAB_THRESHOLD
+/*
+ * slab_malloc - Hand out the first free slot of a partially used page of
+ * the request's size class, starting a new page if there is none.
+ */
+static void *slab_malloc(size_t size) {
+    size_t index = SLAB_INDEX(size);
+    slab_page_t *page = slab_partial[index];
+    size_t word, slot;
+
+    if (page == NULL && (page = slab_page_new(index)) == NULL) {
+        return NULL;
+    }
+
+    // A page on the partial list always has a clear bit
+    for (word = 0; page->used[word] == ~0UL; word++) {
+    }
+    slot = word * SLAB_WORD_BITS + __builtin_ctzl(~page->used[word]);
+    page->used[word] |= 1UL << (slot % SLAB_WORD_BITS);
+
+    if (--page->nfree == 0) {
+        slab_unlink(page);
+    }
+    return (unsigned char *)page + SLAB_HDR_SIZE + slot * SLAB_SLOT_SIZE(index);
+}
+
+/*
+ * slab_free - Release the slot bp of a slab page. An empty page goes back to
+ * the heap unless it is the last page of its class.
+ */
+static void slab_free(slab_page_t *page, void *bp) {
+    size_t index = page->index;
+    size_t slot = ((unsigned char *)bp - (unsigned char *)page - SLAB_HDR_SIZE) /
+                  SLAB_SLOT_SIZE(index);
+
+    page->used[slot / SLAB_WORD_BITS] &= ~(1UL << (slot % SLAB_WORD_BITS));
+    if (page->nfree++ == 0) {
+        slab_link(page);
+    }
+
+    if (page->nfree == SLAB_SLOTS(index) && slab_pages[index] > 1) {
+        slab_unlink(page);
+        slab_pages[index]--;
+        slab_map[SLAB_MAP_INDEX(page)] = 0;
+        free_block(page);
+    }
+}
+
+/*
+ * slab_realloc - Keep the slot if the new size still fits, otherwise move
+ * the payload to a slot or block large enough for it.
+ */
+static void *slab_realloc(slab_page_t *page, void *bp, size_t size) {
+    size_t slot_size = SLAB_SLOT_SIZE(page->index);
+    void *new_ptr;
+
+    if (size <= slot_size) {
+        return bp;
+    }
+
+    if (size <= SLAB_THRESHOLD) {
+        new_ptr = slab_malloc(size);
+#if MMAP_THRESHOLD
+    } else if (size >= MMAP_THRESHOLD) {
+        new_ptr = map_malloc(size);
+#endif
+    } else {
+        new_ptr = malloc_block(adjust_size(size));
+    }
+    if (new_ptr == NULL) return NULL;
+    memcpy(new_ptr, bp, slot_size);
+    slab_free(page, bp);
+    return new_ptr;
+}
+
+/*
+ * slab_page_new - Carve a page-aligned block out of the heap and format it
+ * as an empty slab page of size class index.
+ */
+static slab_page_t *slab_page_new(size_t index) {
+    slab_page_t *page;
+    size_t nslots = SLAB_SLOTS(index);
+
+    // The block's payload is exactly the page, so every address in the page
+    // belongs to the slab
+    page = malloc_aligned_block(SLAB_PAGE_SIZE + DSIZE, SLAB_PAGE_SIZE);
+    if (page == NULL) {
+        return NULL;
+    }
+
+    page->index = index;
+    page->nfree = nslots;
+    memset(page->used, 0, sizeof(page->used));
+    for (size_t i = nslots; i < SLAB_BITMAP_LEN * SLAB_WORD_BITS; i++) {
+        page->used[i / SLAB_WORD_BITS] |= 1UL << (i % SLAB_WORD_BITS);
+    }
+
+    slab_map[SLAB_MAP_INDEX(page)] = 1;
+    slab_map_used = MAX(slab_map_used, SLAB_MAP_INDEX(page) + 1);
+    slab_pages[index]++;
+    slab_link(page);
+    return page;
+}
+
+/*
+ * slab_page_of - Return the slab page holding bp, or NULL if bp is the
+ * payload of an ordinary block.
+ */
+static slab_page_t *slab_page_of(void *bp) {
+    size_t map_index = SLAB_MAP_INDEX(bp);
+
+    if (map_index >= slab_map_len || !slab_map[map_index]) {
+        return NULL;
+    }
+    return (slab_page_t *)((uintptr_t)bp & ~(uintptr_t)(SLAB_PAGE_SIZE - 1));
+}
+
+/*
+ * slab_map_init - Map one slab_map entry for every page the heap can grow to
+ * and clear the entries the previous heap set.
+ */
+static int slab_map_init(void) {
+    size_t len = (mem_max_heap() >> SLAB_PAGE_SHIFT) + 1;
+
+    if (slab_map_len < len) {
+        if (slab_map != NULL) {
+            munmap(slab_map, slab_map_len);
+        }
+        slab_map = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (slab_map == MAP_FAILED) {
+            slab_map = NULL;
+            slab_map_len = 0;
+            return -1;
+        }
+        slab_map_len = len;
+    } else {
+        memset(slab_map, 0, slab_map_used);
+    }
+    slab_map_used = 0;
+    return 0;
+}
+
+/*
+ * slab_link - Push a page onto the partial list of its class.
+ */
+static void slab_link(slab_page_t *page) {
+    slab_page_t *head = slab_partial[page->index];
+
+    page->prev = NULL;
+    page->next = head;
+    if (head != NULL) {
+        head->prev = page;
+    }
+    slab_partial[page->index] = page;
+}
+
+/*
+ * slab_unlink - Remove a page from the partial list of its class.
+ */
+static void slab_unlink(slab_page_t *page) {
+    if (page->prev != NULL) {
+        page->prev->next = page->next;
+    } else {
+        slab_partial[page->index] = page->next;
+    }
+    if (page->next != NULL) {
+        page->next->prev = page->prev;
+    }
+}
+#endif
+
+/*
+ * malloc_aligned_block - Allocate a block of asize bytes whose payload is
+ * aligned to align bytes (a power of two), extending the heap if needed.
+ */
+static void *malloc_aligned_block(size_t asize, size_t align) {
+    void *bp;
+
+    if ((bp = find_aligned_fit(asize, align)) == NULL &&
+        (!consolidate() || (bp = find_aligned_fit(asize, align)) == NULL)) {
+        // Room for the block at any alignment, plus a leading free block
+        if ((bp = extend_heap((asize + align + 2 * DSIZE) / WSIZE)) == NULL) {
+            return NULL;
+        }
+    }
+    return place_aligned(bp, asize, align);
+}
+
+/*
+ * find_aligned_fit - Find a free block that can hold an aligned block of
+ * asize bytes after skipping its aligned_lead bytes.
+ */
+static void *find_aligned_fit(size_t asize, size_t align) {
+    for (size_t i = asize_to_index(asize); i < TREE_INDEX; i++) {
+        for (void *bp = free_listp[i]; bp != NULL; bp = SUCC(bp)) {
+            if (GET_SIZE(HDRP(bp)) >= aligned_lead(bp, align) + asize) {
+                return bp;
+            }
+        }
+    }
+
+    // Any tree block this large fits whatever its alignment
+    return tree_find_fit(asize + align + 2 * DSIZE);
+}
+
+/*
+ * place_aligned - Allocate the aligned part of free block bp, returning the
+ * leading and trailing slack to the free lists.
+ */
+static void *place_aligned(void *bp, size_t asize, size_t align) {
+    size_t csize = GET_SIZE(HDRP(bp));
+    size_t lead = aligned_lead(bp, align);
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+
+    detach_free_list(bp);
+
+    if (lead != 0) {
+        PUT(HDRP(bp), PACK(lead, FREE_BLK | prev_alloc));
+        PUT(FTRP(bp), PACK(lead, FREE_BLK));
+        attach_free_list(bp, lead);
+        bp = NEXT_BLKP(bp);
+        csize -= lead;
+        prev_alloc = 0;
+    }
+
+    if ((csize - asize) >= (2 * DSIZE)) {
+        PUT(HDRP(bp), PACK(asize, ALLOC_BLK | prev_alloc));
+        PUT(HDRP(NEXT_BLKP(bp)),
+            PACK(csize - asize, FREE_BLK | PREV_ALLOC_BLK));
+        PUT(FTRP(NEXT_BLKP(bp)), PACK(csize - asize, FREE_BLK));
+        attach_free_list(NEXT_BLKP(bp), csize - asize);
+    } else {
+        PUT(HDRP(bp), PACK(csize, ALLOC_BLK | prev_alloc));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+    }
+    return bp;
+}
+
+/*
+ * aligned_lead - Bytes to skip from the start of free block bp so that the
+ * payload is aligned and the skipped bytes can stand as a free block.
+ */
+static size_t aligned_lead(void *bp, size_t align) {
+    size_t lead = (align - ((uintptr_t)bp & (align - 1))) & (align - 1);
+
+    while (lead != 0 && lead < 2 * DSIZE) {
+        lead += align;
+    }
+    return lead;
+}
+
+/*
+ * clear_fresh - Zero the first bytes of block bp, which was carved from
+ * fresh heap. Only its free list links or tree node and, if the block was
+ * not split, the footer it had as a free block can be nonzero.
+ */
+static void clear_fresh(void *bp, size_t bytes) {
+    size_t footer = GET_SIZE(HDRP(bp)) - DSIZE;
+
+    memset(bp, 0, MIN(bytes, 3 * sizeof(void *)));
+    if (bytes > footer) {
+        memset((unsigned char *)bp + footer, 0, bytes - footer);
+    }
+}
+
+/*
+ * carve_batch - Split up to n blocks of asize bytes off the front of free
+ * block bp into out, leaving the rest on the free lists. Returns the blocks
+ * carved.
+ */
+static size_t carve_batch(void *bp, size_t asize, size_t n, void **out) {
+    size_t csize = GET_SIZE(HDRP(bp));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+    size_t bsize, done = 0;
+
+    detach_free_list(bp);
+    while (done < n && csize >= asize) {
+        // A tail too small to be a free block goes with the last block
+        bsize = (csize - asize >= 2 * DSIZE) ? asize : csize;
+        PUT(HDRP(bp), PACK(bsize, ALLOC_BLK | prev_alloc));
+        prev_alloc = PREV_ALLOC_BLK;
+        out[done++] = bp;
+        csize -= bsize;
+        bp = NEXT_BLKP(bp);
+    }
+
+    // The block after a free block is allocated, so the rest can't coalesce
+    if (csize > 0) {
+        PUT(HDRP(bp), PACK(csize, FREE_BLK | PREV_ALLOC_BLK));
+        PUT(FTRP(bp), PACK(csize, FREE_BLK));
+        attach_free_list(bp, csize);
+    } else {
+        SET_PREV_ALLOC(HDRP(bp));
+    }
+    return done;
+}
+
+/*
+ * sort_ptrs - Sort n block pointers by address. Batches mostly come in the
+ * order they were allocated or the reverse, which an insertion sort handles
+ * in linear time once a descending array is turned around.
+ */
+static void sort_ptrs(void **ptrs, size_t n) {
+    size_t i, j;
+    void *p;
+
+    if (n > BATCH_SORT_MAX) {
+        qsort(ptrs, n, sizeof(void *), ptr_cmp);
+        return;
+    }
+
+    if (n > 1 && (uintptr_t)ptrs[0] > (uintptr_t)ptrs[n - 1]) {
+        for (i = 0, j = n - 1; i < j; i++, j--) {
+            p = ptrs[i];
+            ptrs[i] = ptrs[j];
+            ptrs[j] = p;
+        }
+    }
+    for (i = 1; i < n; i++) {
+        p = ptrs[i];
+        for (j = i; j > 0 && (uintptr_t)ptrs[j - 1] > (uintptr_t)p; j--) {
+            ptrs[j] = ptrs[j - 1];
+        }
+        ptrs[j] = p;
+    }
+}
+
+/*
+ * ptr_cmp - Order two block pointers by address, for qsort.
+ */
+static int ptr_cmp(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t)*(void *const *)a;
+    uintptr_t y = (uintptr_t)*(void *const *)b;
+
+    return (x > y) - (x < y);
+}
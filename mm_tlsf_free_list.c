@@ -0,0 +1,749 @@
+/*
+ * mm_tlsf_free_list.c - Two-level segregated fit (TLSF) malloc package.
+ *
+ * Free blocks are kept in an array of LIFO doubly linked lists indexed by
+ * two levels. The first level (fl) is the position of the most significant
+ * bit of the block size, and the second level (sl) splits each power-of-two
+ * range into SL_COUNT equal subranges. A bit in fl_bitmap marks every
+ * non-empty first-level row, and a bit in sl_bitmap[fl] marks every
+ * non-empty list in that row.
+ *
+ * mm_malloc rounds the request up to the next list boundary so that any
+ * block in the chosen list is large enough, then finds the first non-empty
+ * list at or above it with two find-first-set operations. Insertion and
+ * removal are O(1) list operations plus a bitmap update, so malloc and free
+ * take constant time no matter how many free blocks the heap holds. Blocks
+ * use the same header format as the other variants: only free blocks carry
+ * a footer, and each header has a bit telling whether the previous block is
+ * allocated, so adjacent free blocks are coalesced immediately.
+ */
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "memlib.h"
+#include "mm.h"
+
+/*********************************************************
+ * Select build options
+ ********************************************************/
+// Requests of at least MMAP_THRESHOLD bytes bypass the lists and get a
+// mapping of their own from mem_map (0 disables).
+#ifndef MMAP_THRESHOLD
+#define MMAP_THRESHOLD (256 * 1024)
+#endif
+
+/*********************************************************
+ * NOTE TO STUDENTS: Before you do anything else, please
+ * provide your team information in the following struct.
+ ********************************************************/
+team_t team = {
+    /* Team name */
+    "ateam",
+    /* First member's full name */
+    "Harry Bovik",
+    /* First member's email address */
+    "bovik@cs.cmu.edu",
+    /* Second member's full name (leave blank if none) */
+    "",
+    /* Second member's email address (leave blank if none) */
+    ""};
+
+/* single word (4) or double word (8) alignment */
+#define ALIGNMENT 8
+
+/* rounds up to the nearest multiple of ALIGNMENT */
+#define ALIGN(size) (((size) + (ALIGNMENT - 1)) & ~0x7)
+
+#define WSIZE     sizeof(void *)  // Word and header / footer size (bytes)
+#define DSIZE     (2 * WSIZE)     // Double word size (bytes)
+#define CHUNKSIZE (1 << 12)       /* Extend heap by this amount (bytes) */
+
+/* Two-level index parameters */
+#define DSIZE_LOG2     ((WSIZE == 8) ? 4 : 3)      // log2(DSIZE)
+#define SL_LOG2        4                           // log2(SL_COUNT)
+#define SL_COUNT       (1 << SL_LOG2)              // Lists per first level
+#define FL_SHIFT       (SL_LOG2 + DSIZE_LOG2)      // First linear-sized level
+#define SMALL_BLK_SIZE (1 << FL_SHIFT)             // Sizes below share fl 0
+#define FL_COUNT       (32 - FL_SHIFT + 1)         // Header sizes are 32-bit
+
+#define MAX(x, y) ((x) > (y) ? (x) : (y))
+#define MIN(x, y) ((x) > (y) ? (y) : (x))
+
+/* Pack a size and allocated bit into a word */
+#define PACK(size, alloc) ((size) | (alloc))
+
+/* Read and write a word at address p */
+#define GET(p)      (*(unsigned int *)(p))
+#define PUT(p, val) (*(unsigned int *)(p) = (val))
+
+/* Read the size and allocated fields from address p */
+#define GET_SIZE(p)       (GET(p) & ~0x7)   // get 0xXXXXX___
+#define GET_ALLOC(p)      (GET(p) & 0x1)    // 0 is free, 1 is allocated
+#define GET_PREV_ALLOC(p) (GET(p) & 0x2)    // 0 if the previous block is free
+#define GET_MAPPED(p)     (GET(p) & 0x4)    // 1 if the block has its own mapping
+
+/* Set or clear the previous-block-allocated bit of the header at p */
+#define SET_PREV_ALLOC(p) PUT(p, GET(p) | PREV_ALLOC_BLK)
+#define CLR_PREV_ALLOC(p) PUT(p, GET(p) & ~PREV_ALLOC_BLK)
+
+/* Given block bp bp, compute address of its header and footer */
+#define HDRP(bp) ((unsigned char *)(bp)-WSIZE)
+#define FTRP(bp) ((unsigned char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)  // free
+
+/* Given block bp bp, compute address of next and previous blocks */
+#define NEXT_BLKP(bp) \
+    ((unsigned char *)(bp) + GET_SIZE(((unsigned char *)(bp)-WSIZE)))
+#define PREV_BLKP(bp) \
+    ((unsigned char *)(bp)-GET_SIZE(((unsigned char *)(bp)-DSIZE)))
+
+#define PRED(bp) (*(unsigned char **)(bp))
+#define SUCC(bp) (*(unsigned char **)((unsigned char *)(bp) + WSIZE))
+
+/* Find-first-set and find-last-set on a non-zero 32-bit word */
+#define FFS(x) ((unsigned int)__builtin_ctz(x))
+#define FLS(x) ((unsigned int)(31 - __builtin_clz(x)))
+
+typedef enum {
+    ZERO_BLK = 0,
+    FREE_BLK = 0,
+    ALLOC_BLK = 1,
+    PREV_ALLOC_BLK = 2,
+    MAPPED_BLK = 4
+} block_status_t;
+
+/* Declarations */
+static void place(void *bp, size_t asize);
+static void *find_fit(size_t asize);
+static void *extend_heap(size_t);
+static void *coalesce(void *);
+static void *attach_free_list(void *bp, size_t asize);
+static void *detach_free_list(void *bp);
+static void mapping_insert(size_t asize, unsigned int *fl, unsigned int *sl);
+static void mapping_search(size_t asize, unsigned int *fl, unsigned int *sl);
+static void *place_aligned(void *bp, size_t asize, size_t align);
+static size_t aligned_lead(void *bp, size_t align);
+#if MMAP_THRESHOLD
+static void *map_malloc(size_t size);
+static void map_free(void *bp);
+static void *map_realloc(void *bp, size_t size);
+static size_t map_len(size_t size);
+#endif
+
+/* Heap list */
+static void *heap_listp = NULL;
+static unsigned int fl_bitmap = 0;
+static unsigned int sl_bitmap[FL_COUNT];
+static void *free_listp[FL_COUNT][SL_COUNT];
+
+/*
+ * mm_init - initialize the malloc package.
+ */
+int mm_init(void) {
+    // Create the initial emtpy heap
+    if ((heap_listp = mem_sbrk(4 * WSIZE)) == (void *)-1) {
+        return -1;
+    }
+
+    PUT(heap_listp, 0);  // Alignment padding
+    PUT(heap_listp + (1 * WSIZE),
+        PACK(DSIZE, ALLOC_BLK | PREV_ALLOC_BLK));  // Prologue header
+    PUT(heap_listp + (2 * WSIZE),
+        PACK(DSIZE, ALLOC_BLK | PREV_ALLOC_BLK));  // Prologue footer
+    PUT(heap_listp + (3 * WSIZE),
+        PACK(0, ALLOC_BLK | PREV_ALLOC_BLK));  // Epilogue header
+
+    // increments the pointer `heap_listp` to skip over the prologue block
+    heap_listp = heap_listp + (2 * WSIZE);
+
+    fl_bitmap = 0;
+    memset(sl_bitmap, 0, sizeof(sl_bitmap));
+    memset(free_listp, 0, sizeof(free_listp));
+
+    // Extend the empty heap with a free block of CHUNKSIZE bytes
+    if (extend_heap(CHUNKSIZE / WSIZE) == NULL) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * mm_malloc - Allocate a block from the first non-empty list whose blocks
+ *     are all at least asize bytes, extending the heap if there is none.
+ */
+void *mm_malloc(size_t size) {
+    size_t asize;
+    size_t extend_size;
+    unsigned char *bp;
+
+    if (size == 0) {
+        return NULL;
+    }
+
+#if MMAP_THRESHOLD
+    if (size >= MMAP_THRESHOLD) {
+        return map_malloc(size);
+    }
+#endif
+
+    if (size <= DSIZE) {
+        asize = 2 * DSIZE;
+    } else {
+        asize = DSIZE * ((size + WSIZE + DSIZE - 1) / DSIZE);
+    }
+
+    if ((bp = find_fit(asize)) != NULL) {
+        place(bp, asize);
+        return bp;
+    }
+
+    extend_size = MAX(asize, CHUNKSIZE);
+    if ((bp = extend_heap(extend_size / WSIZE)) == NULL) {
+        return NULL;
+    }
+    place(bp, asize);
+    return bp;
+}
+
+/*
+ * mm_free - Mark the block free, merge it with its free neighbours and put
+ *     the result on its list.
+ */
+void mm_free(void *bp) {
+    size_t size = GET_SIZE(HDRP(bp));
+
+#if MMAP_THRESHOLD
+    if (GET_MAPPED(HDRP(bp))) {
+        map_free(bp);
+        return;
+    }
+#endif
+
+    PUT(HDRP(bp), PACK(size, FREE_BLK | GET_PREV_ALLOC(HDRP(bp))));
+    PUT(FTRP(bp), PACK(size, FREE_BLK));
+    CLR_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+    coalesce(bp);
+}
+
+/*
+ * coalesce - Combine adjacent free blocks (bp) in the heap to reduce
+ * fragmentation.
+ */
+static void *coalesce(void *bp) {
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
+    size_t size = GET_SIZE(HDRP(bp));
+
+    // If the previous block and the next block are allocated, it is the default
+    // Case 1: Previous block is allocated, next block is free
+    if (prev_alloc && !next_alloc) {
+        detach_free_list(NEXT_BLKP(bp));
+        size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
+        PUT(HDRP(bp), PACK(size, FREE_BLK | PREV_ALLOC_BLK));
+        PUT(FTRP(bp), PACK(size, FREE_BLK));
+    }
+
+    // Case 2: Previous block is free, next block is allocated
+    else if (!prev_alloc && next_alloc) {
+        detach_free_list(PREV_BLKP(bp));
+        size += GET_SIZE(HDRP(PREV_BLKP(bp)));
+        PUT(FTRP(bp), PACK(size, FREE_BLK));
+        PUT(HDRP(PREV_BLKP(bp)),
+            PACK(size, FREE_BLK | GET_PREV_ALLOC(HDRP(PREV_BLKP(bp)))));
+        bp = PREV_BLKP(bp);
+    }
+
+    // Case 3: Previous block and next block are both free
+    else if (!prev_alloc && !next_alloc) {
+        detach_free_list(PREV_BLKP(bp));
+        detach_free_list(NEXT_BLKP(bp));
+        size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(HDRP(NEXT_BLKP(bp)));
+        PUT(FTRP(NEXT_BLKP(bp)), PACK(size, FREE_BLK));
+        PUT(HDRP(PREV_BLKP(bp)),
+            PACK(size, FREE_BLK | GET_PREV_ALLOC(HDRP(PREV_BLKP(bp)))));
+        bp = PREV_BLKP(bp);
+    }
+
+    attach_free_list(bp, size);
+    return bp;
+}
+
+/*
+ * mm_realloc - Resize in place when the block shrinks or a neighbouring free
+ *     block makes up the difference, otherwise move it.
+ */
+void *mm_realloc(void *bp, size_t size) {
+    void *old_ptr = bp;
+    void *new_ptr;
+    size_t old_size = GET_SIZE(HDRP(old_ptr));
+    size_t new_size;
+
+#if MMAP_THRESHOLD
+    if (GET_MAPPED(HDRP(bp))) {
+        return map_realloc(bp, size);
+    }
+
+    // Grown past the threshold: move the block into a mapping of its own
+    if (size >= MMAP_THRESHOLD) {
+        if ((new_ptr = map_malloc(size)) == NULL) return NULL;
+        memcpy(new_ptr, old_ptr, MIN(size, old_size - WSIZE));
+        mm_free(bp);
+        return new_ptr;
+    }
+#endif
+
+    if (size <= DSIZE) {
+        new_size = 2 * DSIZE;
+    } else {
+        new_size = DSIZE * ((size + WSIZE + DSIZE - 1) / DSIZE);
+    }
+
+    // Case 1: Requested size is equal to the current size
+    if (new_size == old_size) {
+        return old_ptr;
+    }
+
+    // Case 2: Requested size is smaller than the current size
+    else if (new_size < old_size) {
+        if ((old_size - new_size) >= (2 * DSIZE)) {
+            PUT(HDRP(old_ptr),
+                PACK(new_size, ALLOC_BLK | GET_PREV_ALLOC(HDRP(old_ptr))));
+            PUT(HDRP(NEXT_BLKP(old_ptr)),
+                PACK(old_size - new_size, FREE_BLK | PREV_ALLOC_BLK));
+            PUT(FTRP(NEXT_BLKP(old_ptr)), PACK(old_size - new_size, FREE_BLK));
+            CLR_PREV_ALLOC(HDRP(NEXT_BLKP(NEXT_BLKP(old_ptr))));
+            coalesce(NEXT_BLKP(old_ptr));
+        }
+        return old_ptr;
+    }
+
+    // Case 3: Combine with the next free block
+    else if (!GET_ALLOC(HDRP(NEXT_BLKP(old_ptr))) &&
+             (old_size + GET_SIZE(HDRP(NEXT_BLKP(old_ptr)))) >= new_size) {
+        detach_free_list(NEXT_BLKP(old_ptr));
+
+        size_t extended_size = old_size + GET_SIZE(HDRP(NEXT_BLKP(old_ptr)));
+        size_t prev_alloc = GET_PREV_ALLOC(HDRP(old_ptr));
+
+        if ((extended_size - new_size) >= (2 * DSIZE)) {
+            PUT(HDRP(old_ptr), PACK(new_size, ALLOC_BLK | prev_alloc));
+            PUT(HDRP(NEXT_BLKP(old_ptr)),
+                PACK(extended_size - new_size, FREE_BLK | PREV_ALLOC_BLK));
+            PUT(FTRP(NEXT_BLKP(old_ptr)),
+                PACK(extended_size - new_size, FREE_BLK));
+            attach_free_list(NEXT_BLKP(old_ptr), extended_size - new_size);
+        } else {
+            PUT(HDRP(old_ptr), PACK(extended_size, ALLOC_BLK | prev_alloc));
+            SET_PREV_ALLOC(HDRP(NEXT_BLKP(old_ptr)));
+        }
+        return old_ptr;
+    }
+
+    // Case 4: Allocate a new block and free the old block
+    else {
+        new_ptr = mm_malloc(size);
+        if (new_ptr == NULL) return NULL;
+        memcpy(new_ptr, old_ptr, MIN(size, old_size - WSIZE));
+        mm_free(bp);
+        return new_ptr;
+    }
+}
+
+/*
+ * mm_memalign - Allocate a block whose payload is aligned to alignment bytes,
+ *     a power of two. Any block with room for the request at every
+ *     alignment will do, so the search stays two bitmap lookups; the slack
+ *     on either side goes back to the lists.
+ */
+void *mm_memalign(size_t alignment, size_t size) {
+    size_t asize;
+    size_t worst;
+    void *bp;
+
+    if (alignment <= ALIGNMENT) {
+        return mm_malloc(size);
+    }
+    if (size == 0 || (alignment & (alignment - 1)) != 0) {
+        return NULL;
+    }
+
+    if (size <= DSIZE) {
+        asize = 2 * DSIZE;
+    } else {
+        asize = DSIZE * ((size + WSIZE + DSIZE - 1) / DSIZE);
+    }
+
+    // The block, preceded by the largest lead aligned_lead can ask for
+    worst = asize + alignment + 2 * DSIZE;
+    if ((bp = find_fit(worst)) == NULL &&
+        (bp = extend_heap(worst / WSIZE)) == NULL) {
+        return NULL;
+    }
+    return place_aligned(bp, asize, alignment);
+}
+
+/*
+ * mm_posix_memalign - mm_memalign with the interface of posix_memalign.
+ */
+int mm_posix_memalign(void **memptr, size_t alignment, size_t size) {
+    void *bp;
+
+    if (alignment % sizeof(void *) != 0 ||
+        (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    if ((bp = mm_memalign(alignment, size)) == NULL && size != 0) {
+        return ENOMEM;
+    }
+    *memptr = bp;
+    return 0;
+}
+
+/*
+ * mm_calloc - Allocate a zeroed array of nmemb elements of size bytes.
+ */
+void *mm_calloc(size_t nmemb, size_t size) {
+    unsigned char *fresh = mem_fresh_lo();
+    size_t bytes, footer;
+    unsigned char *bp;
+
+    if (size != 0 && nmemb > SIZE_MAX / size) {
+        return NULL;
+    }
+    bytes = nmemb * size;
+
+#if MMAP_THRESHOLD
+    // A new mapping is already zero
+    if (bytes >= MMAP_THRESHOLD) {
+        return map_malloc(bytes);
+    }
+#endif
+
+    if ((bp = mm_malloc(bytes)) == NULL) {
+        return NULL;
+    }
+
+    // Heap that mem_sbrk had never handed out is zero, but for the list
+    // links and footer the block had while it was free
+    if (bp >= fresh) {
+        footer = GET_SIZE(HDRP(bp)) - DSIZE;
+        memset(bp, 0, MIN(bytes, DSIZE));
+        if (bytes > footer) {
+            memset(bp + footer, 0, bytes - footer);
+        }
+    } else {
+        memset(bp, 0, bytes);
+    }
+    return bp;
+}
+
+/*
+ * mm_trim - Give the free block at the end of the heap back to memlib,
+ * keeping pad bytes of it. Returns 1 if the heap shrank.
+ */
+int mm_trim(size_t pad) {
+    unsigned char *epilogue = (unsigned char *)mem_heap_hi() + 1 - WSIZE;
+    size_t size, keep;
+    void *bp;
+
+    // The block before the epilogue must be free
+    if (GET_PREV_ALLOC(epilogue)) {
+        return 0;
+    }
+    size = GET_SIZE(epilogue - WSIZE);
+    bp = epilogue - size + WSIZE;
+
+    // What stays behind must still be a valid free block
+    keep = DSIZE * ((pad + (DSIZE - 1)) / DSIZE);
+    if (keep != 0 && keep < 2 * DSIZE) {
+        keep = 2 * DSIZE;
+    }
+    if (keep >= size) {
+        return 0;
+    }
+
+    detach_free_list(bp);
+    if (keep == 0) {
+        PUT(HDRP(bp), PACK(0, ALLOC_BLK | GET_PREV_ALLOC(HDRP(bp))));
+    } else {
+        PUT(HDRP(bp), PACK(keep, FREE_BLK | GET_PREV_ALLOC(HDRP(bp))));
+        PUT(FTRP(bp), PACK(keep, FREE_BLK));
+        PUT(HDRP(NEXT_BLKP(bp)), PACK(0, ALLOC_BLK));  // New epilogue header
+        attach_free_list(bp, keep);
+    }
+    mem_sbrk(-(int)(size - keep));
+    return 1;
+}
+
+/*
+ * mm_heapstats - Count the free blocks by walking the heap, and sort them
+ * into the first-level size classes.
+ */
+int mm_heapstats(mm_heapstats_t *stats) {
+    unsigned int fl, sl;
+    size_t size;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->nbins = FL_COUNT;
+
+    for (void *bp = heap_listp; (size = GET_SIZE(HDRP(bp))) != 0;
+         bp = NEXT_BLKP(bp)) {
+        if (GET_ALLOC(HDRP(bp))) {
+            continue;
+        }
+        stats->free_blocks++;
+        stats->free_bytes += size;
+        stats->largest_free = MAX(stats->largest_free, size);
+        mapping_insert(size, &fl, &sl);
+        stats->bin_blocks[fl]++;
+    }
+    return 0;
+}
+
+/*
+ * extend_heap - Extend the heap by allocating a new free block.
+ */
+static void *extend_heap(size_t words) {
+    char *bp;
+    size_t size;
+
+    // Allocate an even number of words to maintain alignment
+    size = (words % 2) ? (words + 1) * WSIZE : words * WSIZE;
+    if ((long)(bp = mem_sbrk(size)) == -1) {
+        return NULL;
+    }
+
+    // Initialize free block header/footer and the epilogue header. The new
+    // block takes over the old epilogue's previous-allocated bit.
+    PUT(HDRP(bp), PACK(size, FREE_BLK | GET_PREV_ALLOC(HDRP(bp))));
+    PUT(FTRP(bp), PACK(size, FREE_BLK));           // Free block footer
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, ALLOC_BLK));  // New epilogue header
+
+    // Coalesce if the previous block was free
+    return coalesce(bp);
+}
+
+/*
+ * find_fit - Return the head of the first non-empty list whose blocks are
+ * all at least asize bytes, using the two bitmaps instead of a list walk.
+ */
+static void *find_fit(size_t asize) {
+    unsigned int fl, sl;
+    unsigned int sl_map, fl_map;
+
+    mapping_search(asize, &fl, &sl);
+    if (fl >= FL_COUNT) {
+        return NULL;
+    }
+
+    // Look for a non-empty list in the same first-level row
+    sl_map = sl_bitmap[fl] & (~0U << sl);
+    if (sl_map == 0) {
+        // Otherwise take the smallest non-empty row above it
+        fl_map = (fl + 1 < FL_COUNT) ? fl_bitmap & (~0U << (fl + 1)) : 0;
+        if (fl_map == 0) {
+            return NULL;
+        }
+        fl = FFS(fl_map);
+        sl_map = sl_bitmap[fl];
+    }
+    sl = FFS(sl_map);
+
+    return free_listp[fl][sl];
+}
+
+/*
+ * place - Place a block of the specified size at the beginning of the free
+ * block(bp).
+ */
+static void place(void *bp, size_t asize) {
+    size_t csize = GET_SIZE(HDRP(bp));
+    detach_free_list(bp);
+
+    // Check if splitting the block is necessary
+    if ((csize - asize) >= (2 * DSIZE)) {
+        PUT(HDRP(bp), PACK(asize, ALLOC_BLK | GET_PREV_ALLOC(HDRP(bp))));
+        bp = NEXT_BLKP(bp);
+        PUT(HDRP(bp), PACK(csize - asize, FREE_BLK | PREV_ALLOC_BLK));
+        PUT(FTRP(bp), PACK(csize - asize, FREE_BLK));
+        attach_free_list(bp, csize - asize);
+    }
+    // Allocate the entire block without splitting
+    else {
+        PUT(HDRP(bp), PACK(csize, ALLOC_BLK | GET_PREV_ALLOC(HDRP(bp))));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+    }
+}
+
+/*
+ * attach_free_list - Push a free block (bp) onto the head of its list and
+ * mark the list non-empty in both bitmaps.
+ */
+static void *attach_free_list(void *bp, size_t asize) {
+    unsigned int fl, sl;
+    void *head;
+
+    mapping_insert(asize, &fl, &sl);
+    head = free_listp[fl][sl];
+
+    PRED(bp) = NULL;
+    SUCC(bp) = head;
+    if (head != NULL) {
+        PRED(head) = bp;
+    }
+    free_listp[fl][sl] = bp;
+
+    fl_bitmap |= 1U << fl;
+    sl_bitmap[fl] |= 1U << sl;
+    return bp;
+}
+
+/*
+ * detach_free_list - Unlink a free block (bp) from its list, clearing the
+ * bitmap bits when the list becomes empty.
+ */
+static void *detach_free_list(void *bp) {
+    unsigned int fl, sl;
+
+    mapping_insert(GET_SIZE(HDRP(bp)), &fl, &sl);
+
+    if (PRED(bp) != NULL) {
+        SUCC(PRED(bp)) = SUCC(bp);
+    } else {
+        free_listp[fl][sl] = SUCC(bp);
+    }
+    if (SUCC(bp) != NULL) {
+        PRED(SUCC(bp)) = PRED(bp);
+    }
+
+    if (free_listp[fl][sl] == NULL) {
+        sl_bitmap[fl] &= ~(1U << sl);
+        if (sl_bitmap[fl] == 0) {
+            fl_bitmap &= ~(1U << fl);
+        }
+    }
+    return bp;
+}
+
+/*
+ * place_aligned - Allocate the aligned part of free block bp, returning the
+ * leading and trailing slack to the lists.
+ */
+static void *place_aligned(void *bp, size_t asize, size_t align) {
+    size_t csize = GET_SIZE(HDRP(bp));
+    size_t lead = aligned_lead(bp, align);
+
+    if (lead != 0) {
+        detach_free_list(bp);
+        PUT(HDRP(bp), PACK(lead, FREE_BLK | GET_PREV_ALLOC(HDRP(bp))));
+        PUT(FTRP(bp), PACK(lead, FREE_BLK));
+        attach_free_list(bp, lead);
+        bp = NEXT_BLKP(bp);
+        PUT(HDRP(bp), PACK(csize - lead, FREE_BLK));
+        PUT(FTRP(bp), PACK(csize - lead, FREE_BLK));
+        attach_free_list(bp, csize - lead);
+    }
+    place(bp, asize);
+    return bp;
+}
+
+/*
+ * aligned_lead - Bytes to skip from the start of free block bp so that the
+ * payload is aligned and the skipped bytes can stand as a free block.
+ */
+static size_t aligned_lead(void *bp, size_t align) {
+    size_t lead = (align - ((uintptr_t)bp & (align - 1))) & (align - 1);
+
+    while (lead != 0 && lead < 2 * DSIZE) {
+        lead += align;
+    }
+    return lead;
+}
+
+/*
+ * mapping_insert - Compute the list (fl, sl) that holds blocks of size asize.
+ */
+static void mapping_insert(size_t asize, unsigned int *fl, unsigned int *sl) {
+    unsigned int size = (unsigned int)asize;
+    unsigned int msb;
+
+    // Small blocks are spread linearly over the lists of the first row
+    if (size < SMALL_BLK_SIZE) {
+        *fl = 0;
+        *sl = size >> DSIZE_LOG2;
+        return;
+    }
+
+    msb = FLS(size);
+    *fl = msb - FL_SHIFT + 1;
+    *sl = (size >> (msb - SL_LOG2)) ^ SL_COUNT;
+}
+
+/*
+ * mapping_search - Compute the first list (fl, sl) whose blocks are all at
+ * least asize bytes, by rounding asize up to the next list boundary.
+ */
+static void mapping_search(size_t asize, unsigned int *fl, unsigned int *sl) {
+    if (asize >= SMALL_BLK_SIZE) {
+        asize += (1U << (FLS((unsigned int)asize) - SL_LOG2)) - 1;
+    }
+    mapping_insert(asize, fl, sl);
+}
+
+#if MMAP_THRESHOLD
+/*
+ * map_malloc - Serve a request from a mapping of its own. The payload starts
+ * DSIZE bytes in, behind a header holding the mapping length.
+ */
+static void *map_malloc(size_t size) {
+    size_t len = map_len(size);
+    unsigned char *map;
+
+    if (len == 0 || (map = mem_map(len)) == NULL) {
+        return NULL;
+    }
+    PUT(map + DSIZE - WSIZE, PACK(len, ALLOC_BLK | MAPPED_BLK));
+    return map + DSIZE;
+}
+
+/*
+ * map_free - Give the mapping of block bp back to memlib.
+ */
+static void map_free(void *bp) {
+    mem_unmap((unsigned char *)bp - DSIZE, GET_SIZE(HDRP(bp)));
+}
+
+/*
+ * map_realloc - Resize the mapping of block bp, which may move it.
+ */
+static void *map_realloc(void *bp, size_t size) {
+    size_t old_len = GET_SIZE(HDRP(bp));
+    size_t len = map_len(size);
+    unsigned char *map;
+
+    if (len == old_len) {
+        return bp;
+    }
+    if (len == 0 ||
+        (map = mem_remap((unsigned char *)bp - DSIZE, old_len, len)) == NULL) {
+        return NULL;
+    }
+    PUT(map + DSIZE - WSIZE, PACK(len, ALLOC_BLK | MAPPED_BLK));
+    return map + DSIZE;
+}
+
+/*
+ * map_len - Length of the mapping for a request of size bytes, or 0 if the
+ * header can't record it.
+ */
+static size_t map_len(size_t size) {
+    size_t pagesize = mem_pagesize();
+    size_t len = (size + DSIZE + pagesize - 1) & ~(pagesize - 1);
+
+    return len > 0xFFFFFFF8 ? 0 : len;
+}
+#endif
@@ -0,0 +1,69 @@
+/*
+ * mm_variants.c - The table of malloc packages linked into mdriver.
+ *     See mm_variants.h.
+ */
+#include <string.h>
+
+#include "mm_variants.h"
+
+/* Declares the renamed entry points of one variant. mm_trim,
+   mm_heapstats, mm_calloc, mm_memalign and the batch calls are
+   optional, so a package without them links with NULL entries. */
+#define DECLARE_VARIANT(v)					\
+    extern team_t v##_team;					\
+    extern int v##_mm_init(void);				\
+    extern void *v##_mm_malloc(size_t size);			\
+    extern void v##_mm_free(void *ptr);				\
+    extern void *v##_mm_realloc(void *ptr, size_t size);	\
+    extern int v##_mm_trim(size_t pad) __attribute__((weak));	\
+    extern int v##_mm_heapstats(mm_heapstats_t *stats) __attribute__((weak)); \
+    extern void *v##_mm_calloc(size_t nmemb, size_t size)	\
+	__attribute__((weak));					\
+    extern void *v##_mm_memalign(size_t alignment, size_t size)	\
+	__attribute__((weak));					\
+    extern size_t v##_mm_malloc_batch(size_t size, size_t n, void **out) \
+	__attribute__((weak));					\
+    extern void v##_mm_free_batch(void **ptrs, size_t n)	\
+	__attribute__((weak))
+
+/* The table entry for one variant */
+#define VARIANT(v, thread_safe)						\
+    { #v, &v##_team, thread_safe, v##_mm_init, v##_mm_malloc,	\
+      v##_mm_free, v##_mm_realloc, v##_mm_trim, v##_mm_heapstats,	\
+      v##_mm_calloc, v##_mm_memalign, v##_mm_malloc_batch,	\
+      v##_mm_free_batch }
+
+#ifdef HAVE_MM_C
+DECLARE_VARIANT(mm);
+#endif
+DECLARE_VARIANT(segregated);
+DECLARE_VARIANT(segregated_mt);
+DECLARE_VARIANT(explicit);
+DECLARE_VARIANT(implicit);
+DECLARE_VARIANT(tlsf);
+
+mm_variant_t mm_variants[] = {
+#ifdef HAVE_MM_C
+    VARIANT(mm, 0),
+#endif
+    VARIANT(segregated, 0),
+    VARIANT(segregated_mt, 1),  /* built with THREAD_CACHE=1 */
+    VARIANT(explicit, 0),
+    VARIANT(implicit, 0),
+    VARIANT(tlsf, 0),
+    { NULL }
+};
+
+/*
+ * mm_find_variant - Return the variant called name, or NULL
+ */
+mm_variant_t *mm_find_variant(char *name)
+{
+    mm_variant_t *v;
+
+    for (v = mm_variants; v->name != NULL; v++) {
+	if (!strcmp(v->name, name))
+	    return v;
+    }
+    return NULL;
+}
@@ -0,0 +1,30 @@
+/*
+ * mm_variants.h - The malloc packages linked into mdriver.
+ *
+ * The Makefile compiles each mm_*_free_list.c (and mm.c, if present)
+ * with its entry points and team renamed to <variant>_mm_init,
+ * <variant>_team and so on, so that all of them can live in one
+ * program. mdriver reaches them through this table.
+ */
+#include "mm.h"
+
+typedef struct {
+    char *name;        /* name the variant is selected by */
+    team_t *team;      /* the variant's team structure */
+    int thread_safe;   /* may be called from several threads at once */
+    int (*init)(void);
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    int (*trim)(size_t pad);                 /* NULL if not provided */
+    int (*heapstats)(mm_heapstats_t *stats); /* NULL if not provided */
+    void *(*calloc)(size_t nmemb, size_t size);          /* NULL if not */
+    void *(*memalign)(size_t alignment, size_t size);    /* NULL if not */
+    size_t (*malloc_batch)(size_t size, size_t n, void **out); /* or NULL */
+    void (*free_batch)(void **ptrs, size_t n);                 /* or NULL */
+} mm_variant_t;
+
+/* Every linked variant, the default first, ended by a NULL name */
+extern mm_variant_t mm_variants[];
+
+mm_variant_t *mm_find_variant(char *name);
@@ -71,7 +71,7 @@ while ($line = <STDIN>) {
     chomp($line);
     $linenum++;
 
-    ($cmd, $id, $size) = split(" ", $line);
+    ($cmd, $id, $size, $count) = split(" ", $line);
 
     # ignore blank lines
     if (!$cmd) {
@@ -81,37 +81,54 @@ while ($line = <STDIN>) {
     # save the line for output later
     $lines[$requestnum++] = $line;
 
-    #ignore realloc requests, as long as they are preceeded by an alloc request
-    if ($cmd eq "r") {
-	if (!$HASH{$id}) {
-	    die "$0: ERROR[$linenum]: realloc without previous alloc\n";
-	}
-	next;
+    # calloc and memalign requests allocate just like a requests, and a
+    # batch stands for one a or f request on each of its ids
+    @ids = ($id);
+    if ($cmd eq "c" or $cmd eq "m") {
+	$cmd = "a";
     }
-
-    if ($cmd eq "a" and $HASH{$id} eq "a") {
-	die "$0: ERROR[$linenum]: allocate with no intervening free.\n";
+    elsif ($cmd eq "b") {
+	@ids = ($id .. $id + $count - 1);
+	$cmd = "a";
     }
-
-    if ($cmd eq "a" and $HASH{$id} eq "f") {
-	die "$0: ERROR[$linenum]: reused ID $id.\n";
+    elsif ($cmd eq "B") {
+	@ids = ($id .. $id + $size - 1);
+	$cmd = "f";
     }
 
-    if ($cmd eq "f" and !exists($HASH{$id})) {
-	die "$0: ERROR[$linenum]: freeing unallocated block.\n";
-	next;
-    }
+    foreach $id (@ids) {
+	#ignore realloc requests, as long as they are preceeded by an alloc request
+	if ($cmd eq "r") {
+	    if (!$HASH{$id}) {
+		die "$0: ERROR[$linenum]: realloc without previous alloc\n";
+	    }
+	    next;
+	}
 
-    if ($cmd eq "f" and !$HASH{$id} eq "f") {
-	die "$0: ERROR[$linenum]: freeing already freed block.\n";
-	next;
-    }
-    
-    if ($cmd eq "f") {
-	delete $HASH{$id};
-    }
-    else {
-	$HASH{$id} = $cmd;
+	if ($cmd eq "a" and $HASH{$id} eq "a") {
+	    die "$0: ERROR[$linenum]: allocate with no intervening free.\n";
+	}
+
+	if ($cmd eq "a" and $HASH{$id} eq "f") {
+	    die "$0: ERROR[$linenum]: reused ID $id.\n";
+	}
+
+	if ($cmd eq "f" and !exists($HASH{$id})) {
+	    die "$0: ERROR[$linenum]: freeing unallocated block.\n";
+	    next;
+	}
+
+	if ($cmd eq "f" and !$HASH{$id} eq "f") {
+	    die "$0: ERROR[$linenum]: freeing already freed block.\n";
+	    next;
+	}
+
+	if ($cmd eq "f") {
+	    delete $HASH{$id};
+	}
+	else {
+	    $HASH{$id} = $cmd;
+	}
     }
 }
 
@@ -0,0 +1,384 @@
+#!/usr/bin/perl
+#!/usr/local/bin/perl
+use Getopt::Std;
+
+#######################################################################
+# gen_workload - generate a balanced synthetic trace from a config.
+#
+# The config describes one or more classes of objects, each with its
+# own share of the allocations, size distribution, lifetime
+# distribution and realloc pattern (see workload.conf for the syntax).
+# Time advances by one tick per allocation; an object is freed
+# <lifetime> ticks after it was allocated, and its reallocs are spread
+# evenly over that span. Once <ops> requests have been generated the
+# objects still live are freed, oldest deadline first, so the trace is
+# balanced and passes checktrace.pl -s.
+#
+# The requests are spooled to <outfile>.tmp, because the header must
+# carry the final counts, and then copied behind the header. With -b
+# the trace is written in the binary format read by mdriver (see
+# rep2bin.pl) instead of as text.
+#
+#######################################################################
+
+$| = 1; # autoflush output on every print statement
+
+#
+# void usage(void) - print help message and terminate
+#
+sub usage
+{
+    printf STDERR "$_[0]\n";
+    printf STDERR "Usage: $0 [-hb] -c <config> -o <outfile>\n";
+    printf STDERR "Options:\n";
+    printf STDERR "  -h          Print this message\n";
+    printf STDERR "  -b          Write a binary trace\n";
+    printf STDERR "  -c <config> Workload description\n";
+    printf STDERR "  -o <file>   Output trace\n";
+    die "\n" ;
+}
+
+#
+# Distributions. Each is an array ref [kind, params...] as parsed by
+# parse_dist, and sample() draws one value from it.
+#
+sub parse_dist
+{
+    my ($what, $line, @words) = @_;
+    my $kind = shift @words;
+    my @hist;
+
+    if ($kind eq "fixed" and @words == 1) {
+	return ["fixed", $words[0]];
+    }
+    if ($kind eq "uniform" and @words == 2 and $words[0] <= $words[1]) {
+	return ["uniform", @words];
+    }
+    if ($kind eq "lognormal" and @words == 2 and $words[0] > 0) {
+	return ["lognormal", log($words[0]), $words[1]];
+    }
+    if ($kind eq "exponential" and @words == 1 and $words[0] > 0) {
+	return ["exponential", $words[0]];
+    }
+    if ($kind eq "histogram" and @words >= 1) {
+	# value:weight pairs, stored as cumulative weights
+	my $total = 0;
+	foreach $pair (@words) {
+	    my ($value, $weight) = split(":", $pair);
+	    die "$0: ERROR[$line]: bad histogram entry $pair.\n"
+		unless defined($weight) and $weight > 0;
+	    $total += $weight;
+	    push @hist, [$value, $total];
+	}
+	return ["histogram", $total, @hist];
+    }
+    if ($kind eq "forever" and @words == 0 and $what eq "lifetime") {
+	return ["forever"];
+    }
+    die "$0: ERROR[$line]: bad $what distribution '$kind @words'.\n";
+}
+
+sub sample
+{
+    my ($dist) = @_;
+    my $kind = $dist->[0];
+    my ($u, $v, $r, $i);
+
+    if ($kind eq "fixed") {
+	return $dist->[1];
+    }
+    if ($kind eq "uniform") {
+	return $dist->[1] + int(rand($dist->[2] - $dist->[1] + 1));
+    }
+    if ($kind eq "lognormal") {
+	# Box-Muller transform of two uniform samples
+	$u = 1.0 - rand();
+	$v = rand();
+	return int(exp($dist->[1] +
+		       $dist->[2] * sqrt(-2 * log($u)) * cos(6.283185307 * $v)));
+    }
+    if ($kind eq "exponential") {
+	return int(-$dist->[1] * log(1.0 - rand()));
+    }
+    if ($kind eq "histogram") {
+	$r = rand($dist->[1]);
+	for ($i = 2; $i < $#$dist; $i++) {
+	    last if $r < $dist->[$i][1];
+	}
+	return $dist->[$i][0];
+    }
+    return -1; # forever
+}
+
+#
+# Event queue: a binary min-heap of [tick, type, id] entries, where
+# type is "r" or "f". Reallocs of an object are queued before its free
+# and share no tick with it, so ties never reorder an object's requests.
+#
+sub push_event
+{
+    my ($event) = @_;
+    my $i = scalar(@queue);
+    my $parent;
+
+    push @queue, $event;
+    while ($i > 0) {
+	$parent = ($i - 1) >> 1;
+	last if $queue[$parent][0] <= $event->[0];
+	$queue[$i] = $queue[$parent];
+	$i = $parent;
+    }
+    $queue[$i] = $event;
+}
+
+sub pop_event
+{
+    my $top = $queue[0];
+    my $last = pop @queue;
+    my ($i, $child, $n);
+
+    return $top unless @queue;
+    $n = scalar(@queue);
+    $i = 0;
+    while (($child = 2 * $i + 1) < $n) {
+	$child++ if $child + 1 < $n and $queue[$child + 1][0] < $queue[$child][0];
+	last if $last->[0] <= $queue[$child][0];
+	$queue[$i] = $queue[$child];
+	$i = $child;
+    }
+    $queue[$i] = $last;
+    return $top;
+}
+
+#
+# Emit one request to the spool file
+#
+sub emit
+{
+    my ($type, $id, $size) = @_;
+
+    if ($binary) {
+	print SPOOL pack("llll", $TYPES{$type}, $id, $size, 0);
+    }
+    elsif ($type eq "f") {
+	print SPOOL "f $id\n";
+    }
+    else {
+	print SPOOL "$type $id $size\n";
+    }
+    $num_ops++;
+}
+
+#
+# Emit a queued realloc or free
+#
+sub emit_event
+{
+    my ($event) = @_;
+    my ($tick, $type, $id) = @$event;
+    my $class = $classes[$obj_class{$id}];
+    my $pattern = $class->{realloc};
+    my $size = $obj_size{$id};
+
+    if ($type eq "f") {
+	emit("f", $id, 0);
+	$live_bytes -= $size;
+	delete $obj_size{$id};
+	delete $obj_class{$id};
+	return;
+    }
+
+    if ($pattern->[0] eq "grow") {
+	$size = int($size * $pattern->[1]) + 1;
+    }
+    elsif ($pattern->[0] eq "linear") {
+	$size += $pattern->[1];
+    }
+    else { # resize
+	$size = sample($class->{size});
+    }
+    $size = 1 if $size < 1;
+    $size = $max_size if $size > $max_size;
+    $live_bytes += $size - $obj_size{$id};
+    $peak_bytes = $live_bytes if $live_bytes > $peak_bytes;
+    $obj_size{$id} = $size;
+    emit("r", $id, $size);
+}
+
+##############
+# Main routine
+##############
+
+#
+# Parse and check the command line arguments
+#
+getopts('hbc:o:');
+if ($opt_h) {
+    usage("");
+}
+usage("Missing -c or -o argument.") unless $opt_c and $opt_o;
+$binary = $opt_b;
+
+# Request types, in the order of mdriver's traceop_t enum
+%TYPES = ("a" => 0, "f" => 1, "r" => 2);
+
+# Trace header fields are 32-bit ints
+$MAX_BYTES = (1 << 31) - 1;
+
+#
+# Read the config: global settings first, then one [class <name>]
+# section per object class
+#
+$target_ops = 10000;
+$seed = 1;
+$max_size = 1 << 24;
+@classes = ();
+open CONFIG, "<$opt_c" or die "$0: Cannot open $opt_c\n";
+$linenum = 0;
+while ($line = <CONFIG>) {
+    $linenum++;
+    $line =~ s/#.*//;
+    next unless $line =~ /\S/;
+
+    if ($line =~ /^\s*\[\s*class\s+(\S+)\s*\]\s*$/) {
+	$class = {name => $1, weight => 1, size => ["fixed", 16],
+		  lifetime => ["forever"], realloc => ["none"]};
+	push @classes, $class;
+	next;
+    }
+    ($key, $value) = ($line =~ /^\s*(\w+)\s*=\s*(.*?)\s*$/) or
+	die "$0: ERROR[$linenum]: expected 'key = value'.\n";
+    @words = split(" ", $value);
+
+    if (!@classes) {
+	if ($key eq "ops") { $target_ops = $value; }
+	elsif ($key eq "seed") { $seed = $value; }
+	elsif ($key eq "max_size") { $max_size = $value; }
+	else { die "$0: ERROR[$linenum]: unknown setting $key.\n"; }
+	next;
+    }
+
+    if ($key eq "weight") {
+	die "$0: ERROR[$linenum]: weight must be positive.\n" unless $value > 0;
+	$class->{weight} = $value;
+    }
+    elsif ($key eq "size") {
+	$class->{size} = parse_dist("size", $linenum, @words);
+    }
+    elsif ($key eq "lifetime") {
+	$class->{lifetime} = parse_dist("lifetime", $linenum, @words);
+    }
+    elsif ($key eq "realloc") {
+	# none | grow <factor> <count> | linear <bytes> <count> | resize <count>
+	if ($words[0] eq "none" and @words == 1) {
+	    $class->{realloc} = ["none", 0, 0];
+	}
+	elsif (($words[0] eq "grow" or $words[0] eq "linear") and @words == 3) {
+	    $class->{realloc} = [@words];
+	}
+	elsif ($words[0] eq "resize" and @words == 2) {
+	    $class->{realloc} = ["resize", 0, $words[1]];
+	}
+	else {
+	    die "$0: ERROR[$linenum]: bad realloc pattern '$value'.\n";
+	}
+    }
+    else {
+	die "$0: ERROR[$linenum]: unknown class setting $key.\n";
+    }
+}
+close CONFIG;
+die "$0: ERROR: $opt_c defines no [class] sections.\n" unless @classes;
+
+# Cumulative class weights, for picking the class of each allocation
+$total_weight = 0;
+foreach $class (@classes) {
+    $total_weight += $class->{weight};
+    push @cum_weights, $total_weight;
+}
+
+srand($seed);
+
+#
+# Generate the requests. Ticks are doubled so that an object's reallocs
+# (odd ticks) never collide with any free (even ticks).
+#
+open SPOOL, ">$opt_o.tmp" or die "$0: Cannot create $opt_o.tmp\n";
+binmode(SPOOL);
+@queue = ();
+$num_ops = 0;
+$num_ids = 0;
+$live_bytes = $peak_bytes = 0;
+$live_requests = 0;
+for ($tick = 0; $num_ops + $live_requests < $target_ops; $tick++) {
+    # Retire everything due by now
+    while (@queue and $queue[0][0] <= 2 * $tick) {
+	$live_requests--;
+	emit_event(pop_event());
+    }
+
+    # Allocate one object of a randomly picked class
+    $r = rand($total_weight);
+    for ($c = 0; $c < $#classes and $r >= $cum_weights[$c]; $c++) {
+    }
+    $class = $classes[$c];
+    $id = $num_ids++;
+    $size = sample($class->{size});
+    $size = 1 if $size < 1;
+    $size = $max_size if $size > $max_size;
+    $obj_size{$id} = $size;
+    $obj_class{$id} = $c;
+    $live_bytes += $size;
+    $peak_bytes = $live_bytes if $live_bytes > $peak_bytes;
+    emit("a", $id, $size);
+
+    # Queue its reallocs and free. Objects that live forever get a
+    # deadline past the end of the trace, and spread their reallocs
+    # over as many ticks as the trace has requests.
+    $lifetime = sample($class->{lifetime});
+    $span = ($lifetime < 0) ? $target_ops : $lifetime;
+    $lifetime = 1e15 if $lifetime < 0;
+    $lifetime = 1 if $lifetime < 1;
+    $span = 1 if $span < 1;
+    $count = $class->{realloc}[2];
+    for ($k = 1; $k <= $count; $k++) {
+	push_event([2 * ($tick + int($span * $k / ($count + 1))) + 1, "r", $id]);
+	$live_requests++;
+    }
+    push_event([2 * ($tick + $lifetime), "f", $id]);
+    $live_requests++;
+}
+
+# Balance the trace
+while (@queue) {
+    emit_event(pop_event());
+}
+close SPOOL;
+
+#
+# Write the header, then copy the spooled requests behind it
+#
+open OUTFILE, ">$opt_o" or die "$0: Cannot create $opt_o\n";
+binmode(OUTFILE);
+$suggested_heap_size = $peak_bytes + 100;
+$suggested_heap_size = $MAX_BYTES if $suggested_heap_size > $MAX_BYTES;
+if ($binary) {
+    print OUTFILE pack("a8llllll", "MMTRACE", 2, $suggested_heap_size,
+		       $num_ids, $num_ops, 1, 0);
+}
+else {
+    print OUTFILE "$suggested_heap_size\n";
+    print OUTFILE "$num_ids\n";
+    print OUTFILE "$num_ops\n";
+    print OUTFILE "1\n";
+}
+open SPOOL, "<$opt_o.tmp" or die "$0: Cannot open $opt_o.tmp\n";
+binmode(SPOOL);
+while (read(SPOOL, $buf, 1 << 20)) {
+    print OUTFILE $buf;
+}
+close SPOOL;
+close OUTFILE;
+unlink "$opt_o.tmp";
+
+exit;
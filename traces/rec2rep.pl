@@ -0,0 +1,287 @@
+#!/usr/bin/perl
+#!/usr/local/bin/perl
+use Getopt::Std;
+
+#######################################################################
+# rec2rep - convert an allocation log recorded by librecord.so into a
+# balanced trace.
+#
+# The log (see mm_record.c) holds 48-byte records of six 64-bit
+# integers in host byte order:
+#
+#   seq, seq0, type (0=a, 1=f, 2=r, 3=c, 4=m), ptr, old, bytes
+#
+# where old is the block passed to a realloc, or the alignment asked
+# of a memalign.
+#
+# Records are replayed in sequence order, with a realloc releasing its
+# old block at seq0 and taking the new one at seq. The log is sorted a
+# bucket at a time, from buckets spooled to <outfile>.tmp.d, so logs
+# larger than memory can be converted. Each block returned gets the
+# next free id, and requests on a block reuse its id. Blocks still
+# live at the end are freed, so the trace passes checktrace.pl -s.
+# Requests the log can't account for (a free of a block allocated
+# before recording started, say) are dropped or repaired and counted
+# on stderr. Zero-byte requests become one-byte requests, which mdriver
+# can check.
+#
+#######################################################################
+
+$| = 1; # autoflush output on every print statement
+
+#
+# void usage(void) - print help message and terminate
+#
+sub usage
+{
+    printf STDERR "$_[0]\n";
+    printf STDERR "Usage: $0 [-hb] -o <outfile> <logfile>\n";
+    printf STDERR "Options:\n";
+    printf STDERR "  -h          Print this message\n";
+    printf STDERR "  -b          Write a binary trace\n";
+    printf STDERR "  -o <file>   Output trace\n";
+    die "\n" ;
+}
+
+#
+# Emit one request to the spool file
+#
+sub emit
+{
+    my ($type, $id, $size, $align) = @_;
+
+    if ($type ne "f") {
+	if ($size == 0) {
+	    $size = 1;
+	}
+	elsif ($size > $MAX_BYTES) {
+	    $size = $MAX_BYTES;
+	    $clamped++;
+	}
+	$live_bytes += $size - ($type eq "r" ? $id_size{$id} : 0);
+	$peak_bytes = $live_bytes if $live_bytes > $peak_bytes;
+	$id_size{$id} = $size;
+    }
+    else {
+	$live_bytes -= $id_size{$id};
+	delete $id_size{$id};
+    }
+
+    if ($binary) {
+	print SPOOL pack("llll", $TYPES{$type}, $id, $size,
+			 $type eq "m" ? $align : 0);
+    }
+    elsif ($type eq "f") {
+	print SPOOL "f $id\n";
+    }
+    elsif ($type eq "m") {
+	print SPOOL "m $id $size $align\n";
+    }
+    else {
+	print SPOOL "$type $id $size\n";
+    }
+    $num_ops++;
+}
+
+#
+# Queue an event for the bucket covering its rebased sequence number,
+# writing the queued events out once they fill the spool buffer
+#
+sub spool
+{
+    $bucket{int($_[0] / $BUCKET_SEQS)} .= pack("Q7", @_);
+    $buffered += 56;
+    flush_buckets() if $buffered >= $SPOOL_BYTES;
+}
+
+#
+# Append the queued events to their bucket files
+#
+sub flush_buckets
+{
+    foreach $b (keys %bucket) {
+	open BUCKET, ">>$dir/$b" or die "$0: Cannot write $dir/$b\n";
+	binmode(BUCKET);
+	print BUCKET $bucket{$b};
+	close BUCKET;
+    }
+    %bucket = ();
+    $buffered = 0;
+}
+
+#
+# Bind a block to a new id, freeing any id the log still had there
+#
+sub take
+{
+    my ($ptr, $id) = @_;
+
+    if (exists $live{$ptr}) {
+	emit("f", $live{$ptr}, 0);
+	$reused++;
+    }
+    $live{$ptr} = $id;
+}
+
+##############
+# Main routine
+##############
+
+#
+# Parse and check the command line arguments
+#
+getopts('hbo:');
+if ($opt_h) {
+    usage("");
+}
+usage("Missing -o argument or log file.") unless $opt_o and @ARGV == 1;
+$binary = $opt_b;
+
+# Request types, in the order of mdriver's traceop_t enum
+%TYPES = ("a" => 0, "f" => 1, "r" => 2, "c" => 3, "m" => 4);
+@NAMES = ("a", "f", "r", "c", "m");
+
+# Trace sizes are 32-bit ints
+$MAX_BYTES = (1 << 31) - 1;
+
+# Sequence numbers per bucket, and bytes of events queued before the
+# buckets are written out
+$BUCKET_SEQS = 1 << 16;
+$SPOOL_BYTES = 1 << 24;
+
+#
+# Find the range of sequence numbers in the log
+#
+open LOG, "<$ARGV[0]" or die "$0: Cannot open $ARGV[0]\n";
+binmode(LOG);
+$num_recs = 0;
+while (($n = read(LOG, $buf, 48)) == 48) {
+    ($seq, $seq0, $type) = unpack("Q3", $buf);
+    $min_seq = $seq if !defined($min_seq) or $seq < $min_seq;
+    $min_seq = $seq0 if $type == 2 and $seq0 < $min_seq;
+    $max_seq = $seq if !defined($max_seq) or $seq > $max_seq;
+    $num_recs++;
+}
+die "$0: ERROR: $ARGV[0] ends in a partial record.\n" if $n;
+
+#
+# Spool each event to its bucket as rebased seq, release, type, ptr,
+# old, bytes and the record's own seq. Release marks the event at seq0
+# where a realloc lets go of its old block, and the realloc's seq ties
+# it to the realloc's own event.
+#
+$dir = "$opt_o.tmp.d";
+mkdir $dir or die "$0: Cannot create $dir\n";
+%bucket = ();
+$buffered = 0;
+seek(LOG, 0, 0);
+while (read(LOG, $buf, 48) == 48) {
+    ($seq, $seq0, $type, $ptr, $old, $size) = unpack("Q6", $buf);
+    spool($seq - $min_seq, 0, $type, $ptr, $old, $size, $seq);
+    spool($seq0 - $min_seq, 1, $type, $ptr, $old, $size, $seq) if $type == 2;
+}
+flush_buckets();
+close LOG;
+$num_buckets = $num_recs ? int(($max_seq - $min_seq) / $BUCKET_SEQS) + 1 : 0;
+
+#
+# Replay the events, a bucket at a time. Sequence numbers are unique
+# and nearly dense, so an array indexed by them sorts a bucket.
+#
+open SPOOL, ">$opt_o.tmp" or die "$0: Cannot create $opt_o.tmp\n";
+binmode(SPOOL);
+%live = ();     # block address -> id
+%moving = ();   # realloc seq -> id, between its release and its end
+$num_ops = 0;
+$num_ids = 0;
+$live_bytes = $peak_bytes = 0;
+$unknown = $reused = $clamped = 0;
+for ($b = 0; $b < $num_buckets; $b++) {
+    next unless open BUCKET, "<$dir/$b";
+    binmode(BUCKET);
+    @events = ();
+    while (read(BUCKET, $buf, 56) == 56) {
+	$events[unpack("Q", $buf) % $BUCKET_SEQS] = $buf;
+    }
+    close BUCKET;
+    unlink "$dir/$b";
+
+    foreach $event (@events) {
+	next unless defined($event);
+	($release, $type, $ptr, $old, $size, $seq) = unpack("x8 Q6", $event);
+
+	if ($release) { # a realloc lets go of its old block
+	    $moving{$seq} = $live{$old};
+	    delete $live{$old};
+	}
+	elsif ($type == 0 or $type == 3 or $type == 4) {
+	    if ($type == 4) { # glibc rounds an alignment up to a power of two
+		for ($align = 1; $align < $old and $align < (1 << 30);
+		     $align <<= 1) {}
+	    }
+	    take($ptr, $num_ids);
+	    emit($NAMES[$type], $num_ids++, $size, $align);
+	}
+	elsif ($type == 1) {
+	    if (exists $live{$ptr}) {
+		emit("f", $live{$ptr}, 0);
+		delete $live{$ptr};
+	    }
+	    else {
+		$unknown++;
+	    }
+	}
+	else {
+	    $id = $moving{$seq};
+	    delete $moving{$seq};
+	    if (defined($id)) {
+		take($ptr, $id);
+		emit("r", $id, $size);
+	    }
+	    else { # the old block predates the log
+		$unknown++;
+		take($ptr, $num_ids);
+		emit("a", $num_ids++, $size);
+	    }
+	}
+    }
+}
+rmdir $dir;
+
+# Balance the trace
+foreach $id (sort { $a <=> $b } values %live) {
+    emit("f", $id, 0);
+}
+close SPOOL;
+
+#
+# Write the header, then copy the spooled requests behind it
+#
+open OUTFILE, ">$opt_o" or die "$0: Cannot create $opt_o\n";
+binmode(OUTFILE);
+$suggested_heap_size = $peak_bytes + 100;
+if ($binary) {
+    print OUTFILE pack("a8llllll", "MMTRACE", 2, $suggested_heap_size,
+		       $num_ids, $num_ops, 1, 0);
+}
+else {
+    print OUTFILE "$suggested_heap_size\n";
+    print OUTFILE "$num_ids\n";
+    print OUTFILE "$num_ops\n";
+    print OUTFILE "1\n";
+}
+open SPOOL, "<$opt_o.tmp" or die "$0: Cannot open $opt_o.tmp\n";
+binmode(SPOOL);
+while (read(SPOOL, $buf, 1 << 20)) {
+    print OUTFILE $buf;
+}
+close SPOOL;
+close OUTFILE;
+unlink "$opt_o.tmp";
+
+printf STDERR "%d records, %d requests, %d ids, peak %d bytes live\n",
+    $num_recs, $num_ops, $num_ids, $peak_bytes;
+printf STDERR "%d requests on unknown blocks, %d reused blocks, " .
+    "%d sizes clamped\n", $unknown, $reused, $clamped;
+
+exit;
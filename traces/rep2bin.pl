@@ -0,0 +1,116 @@
+#!/usr/bin/perl
+#!/usr/local/bin/perl
+use Getopt::Std;
+
+#######################################################################
+# rep2bin - convert a Malloc Lab trace file to the binary trace format.
+#
+# This script reads a text trace (.rep) on stdin and writes the same
+# requests to stdout as a binary trace that mdriver maps and replays
+# in place, without parsing:
+#
+#   32-byte header: "MMTRACE\0", version, sugg_heapsize, num_ids,
+#                   num_ops, weight, reserved (32-bit ints)
+#   num_ops records: type (0=a, 1=f, 2=r, 3=c, 4=m, 5=b, 6=B), id,
+#                    bytes, and the alignment of an m request or the
+#                    block count of a b or B request (32-bit ints)
+#
+# All integers are in host byte order, so convert on the machine that
+# runs mdriver.
+#
+#######################################################################
+
+#
+# void usage(void) - print help message and terminate
+#
+sub usage
+{
+    printf STDERR "$_[0]\n";
+    printf STDERR "Usage: $0 [-h] < trace.rep > trace.bin\n";
+    printf STDERR "Options:\n";
+    printf STDERR "  -h          Print this message\n";
+    die "\n" ;
+}
+
+##############
+# Main routine
+##############
+
+#
+# Parse and check the command line arguments
+#
+getopts('h');
+if ($opt_h) {
+    usage("");
+}
+
+# Request types, in the order of mdriver's traceop_t enum
+%TYPES = ("a" => 0, "f" => 1, "r" => 2, "c" => 3, "m" => 4,
+	  "b" => 5, "B" => 6);
+
+# Read the trace header values
+$heap_size = <STDIN>;
+chomp($heap_size);
+
+$num_ids = <STDIN>;
+chomp($num_ids);
+
+$num_ops = <STDIN>;
+chomp($num_ops);
+
+$weight = <STDIN>;
+chomp($weight);
+
+#
+# Pack every request, checking the counts claimed by the header
+#
+$linenum = 4;
+$requestnum = 0;
+$max_id = -1;
+$records = "";
+while ($line = <STDIN>) {
+    chomp($line);
+    $linenum++;
+
+    ($cmd, $id, $size, $arg) = split(" ", $line);
+
+    # ignore blank lines
+    if (!$cmd) {
+	next;
+    }
+
+    if (!exists($TYPES{$cmd})) {
+	die "$0: ERROR[$linenum]: bogus request type $cmd.\n";
+    }
+    # A batch stands for the ids <id> through <id>+<n>-1
+    if ($cmd eq "B") {
+	($size, $arg) = (0, $size);
+    }
+    elsif ($cmd eq "f") {
+	$size = 0;
+    }
+    else {
+	$last = ($cmd eq "b") ? $id + $arg - 1 : $id;
+	$max_id = $last if $last > $max_id;
+    }
+    if ($cmd ne "m" and $cmd ne "b" and $cmd ne "B") {
+	$arg = 0;
+    }
+
+    $records .= pack("llll", $TYPES{$cmd}, $id, $size, $arg);
+    $requestnum++;
+}
+
+if ($requestnum != $num_ops) {
+    die "$0: ERROR: header claims $num_ops requests, found $requestnum.\n";
+}
+if ($max_id != $num_ids - 1) {
+    die "$0: ERROR: header claims $num_ids ids, found " . ($max_id + 1) . ".\n";
+}
+
+binmode(STDOUT);
+print pack("a8llllll", "MMTRACE", 2, $heap_size, $num_ids, $num_ops,
+	   $weight, 0);
+print $records;
+
+exit;